@@ -2,10 +2,15 @@
 #define __RFapply_h
 
 #include "itkImageToImageFilter.h"
+#include "itkVectorImage.h"
 
 #include "classification.h"
 #include "data.h"
 #include "forest.h"
+#include "compiledforest.h"
+#include "quickscorer.h"
+#include "forestkernel.h"
+#include "RFforest.h"
 
 #include <iostream>
 #include <ostream>
@@ -23,11 +28,24 @@ namespace itk
           typedef SmartPointer< Self > Pointer;
 
           typedef TImage InputImageType;
+          typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
           typedef typename InputImageType::Pointer InputImagePointer;
           typedef typename InputImageType::RegionType InputImageRegionType;
           typedef typename InputImageType::IndexType InputImageIndexType;
           typedef typename InputImageType::SizeType InputImageSizeType;
 
+          /** Per-class probabilities of every pixel, in class index order **/
+          typedef VectorImage<float, TImage::ImageDimension> ProbabilityImageType;
+
+          /** Votes of the trees summed per class, before averaging **/
+          typedef VectorImage<float, TImage::ImageDimension> VoteSumImageType;
+
+          /** Foreground mask, non-zero on the pixels to classify **/
+          typedef Image<unsigned char, TImage::ImageDimension> MaskImageType;
+
+          /** Index of every pixel's leaf within each tree, in tree order **/
+          typedef VectorImage<unsigned short, TImage::ImageDimension> LeafImageType;
+
           /** Method for creation through the object factory. */
           itkNewMacro(Self);
 
@@ -41,23 +59,117 @@ namespace itk
           void SetInputImage(const InputImagePointer image);
           void SetDummyImage(const InputImagePointer dummy);
 
-          /** The forest binary filename.*/
+          /** The forest binary filename, read once on first execution.*/
           void SetForestFileName(const std::string forestFileName);
 
+          /** An already loaded forest, shared instead of reading the file.*/
+          void SetForest(RFforest *forest);
+          RFforest * GetForest();
+
           /** The number of components **/
           void SetNComp(const unsigned short nComp);
 
           /** The number of components **/
           void SetNClass(const unsigned short nClass);
 
+          /** The forest evaluator: compiled tree traversal, QuickScorer or
+           *  a kernel generated by icell_compile **/
+          enum EvaluatorType { TreeEvaluator, QuickScorerEvaluator, KernelEvaluator };
+          void SetEvaluator(const EvaluatorType evaluator);
+
+          /** The kernel library used by KernelEvaluator, generated by
+           *  icell_compile for the forest. It is loaded by the filter, the
+           *  shared forest is left as it is **/
+          void SetKernelFileName(const std::string kernelFileName);
+
+          /** How leaf votes are summed: exact, 16/8 bit fixed point or hard **/
+          void SetVoteMode(const VoteMode voteMode);
+
+          /** Check the evaluator's leaves against DecisionTree::Apply **/
+          void SetCheckEvaluator(const bool checkEvaluator);
+
+          /** Stop travelling trees once a pixel's label is settled. With a
+           *  margin of 0 the labels are exact, a positive margin also stops
+           *  once the average vote gap reaches it **/
+          void SetEarlyExit(const bool earlyExit);
+          void SetEarlyExitMargin(const double margin);
+
+          /** The second output: per-class probabilities, computed with the
+           *  labels of the same requested region. Only kept when enabled **/
+          void SetProbabilityOutput(const bool probabilityOutput);
+          ProbabilityImageType * GetProbabilityOutput();
+
+          /** The third output: the leaf reached in every tree, to predict
+           *  again from it with RFrepredict. Only kept when enabled, it
+           *  needs every tree to have at most 65536 leaves and no early exit **/
+          void SetLeafOutput(const bool leafOutput);
+          LeafImageType * GetLeafOutput();
+
+          /** The fourth output: the votes of the trees summed per class,
+           *  kept to update the predictions when the forest changes. Only
+           *  kept when enabled, without early exit **/
+          void SetVoteSumOutput(const bool voteSumOutput);
+          VoteSumImageType * GetVoteSumOutput();
+
+          /** Update the vote sums of an earlier run with the forest
+           *  previousForest, summed with the same vote mode, instead of
+           *  travelling every tree: only the trees that differ between the
+           *  two forests are travelled **/
+          void SetCachedVoteSums(const VoteSumImageType *voteSums);
+          void SetPreviousForestFileName(const std::string previousForestFileName);
+          void SetPreviousForest(RFforest *previousForest);
+
+          /** Number of trees travelled per pixel to update cached vote sums **/
+          SizeValueType GetUpdatedTreeNum() const;
+
+          /** Only classify the pixels of the mask, the others get the
+           *  background label (and no probability). Not with cached vote sums **/
+          void SetMaskImage(const MaskImageType *mask);
+          const MaskImageType * GetMaskImage() const;
+          void SetBackgroundLabel(const int backgroundLabel);
+
+          /** Labels and probabilities of the pixels out of the mask, instead
+           *  of the background label, such as those of a coarser
+           *  classification (see RFcascade) **/
+          void SetFallbackLabels(const TImage *labels);
+          void SetFallbackProbabilities(const ProbabilityImageType *probabilities);
+
+          /** Number of pixels classified, those of the mask if any **/
+          SizeValueType GetForegroundPixels() const;
+
+          /** Number of pixels classified before the last tree **/
+          SizeValueType GetEarlyExitPixels() const;
+
           /** Get the testing samples **/
 
         protected:
           RFapply();
           ~RFapply(){}
 
-          /** Does the real work. */
-          virtual void GenerateData();
+          /** Makes the probability image for output 1, the leaf image for
+           *  output 2 and the vote sum image for output 3. */
+          typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+          using Superclass::MakeOutput;
+          virtual DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx);
+
+          /** Sets one probability and vote sum component per class and one
+           *  leaf component per tree. */
+          virtual void GenerateOutputInformation();
+
+          /** Allocates the labels and the enabled outputs only, the others
+           *  are left without a buffer. */
+          virtual void AllocateOutputs();
+
+          /** Reads the forest and sets up the label mapping before the threads start. */
+          virtual void BeforeThreadedGenerateData();
+
+          /** Adds up the early exit and foreground counts of the threads. */
+          virtual void AfterThreadedGenerateData();
+
+          /** Does the real work: classifies one thread's output region
+           *  against the shared, read-only forest. */
+          virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                            ThreadIdType threadId);
 
           /** Member attributes **/
           typedef float GreyType;
@@ -65,19 +177,49 @@ namespace itk
           typedef Histogram<GreyType, LabelType> HistogramType;
           typedef MLData<GreyType, HistogramType *> TestingDataType;
 
-          typedef Histogram<GreyType, LabelType> RFHistogramType;
-          typedef AxisAlignedClassifier<GreyType, LabelType> RFAxisClassifierType;
-          typedef DecisionForest<RFHistogramType, RFAxisClassifierType, GreyType> RandomForestType;
+          typedef RFforest::RFHistogramType RFHistogramType;
+          typedef RFforest::RFAxisClassifierType RFAxisClassifierType;
+          typedef RFforest::RandomForestType RandomForestType;
+          typedef RFforest::CompiledForestType CompiledForestType;
+          typedef RFforest::QuickScorerType QuickScorerType;
 
           typedef Classification<GreyType, LabelType, RFAxisClassifierType> ClassificationType;
           ClassificationType classification;
 
           std::string m_forestFileName;
+          std::string m_KernelFileName;
+          ForestKernel m_Kernel;
+          RFforest::Pointer m_Forest;
           unsigned short m_nComp;
           unsigned short m_nClass;
+          EvaluatorType m_Evaluator;
+          bool m_CheckEvaluator;
+          VoteMode m_VoteMode;
+          bool m_ProbabilityOutput;
+          bool m_LeafOutput;
+          bool m_VoteSumOutput;
+          int m_BackgroundLabel;
+          SizeValueType m_ForegroundPixels;
+          std::vector<SizeValueType> m_ThreadForegroundPixels;
+          std::string m_PreviousForestFileName;
+          RFforest::Pointer m_PreviousForest;
+          std::vector<index_t> m_RemovedTrees;
+          std::vector<index_t> m_AddedTrees;
+          bool m_EarlyExit;
+          double m_EarlyExitMargin;
+          SizeValueType m_EarlyExitPixels;
+          std::vector<SizeValueType> m_ThreadEarlyExitPixels;
+          std::map<std::size_t, LabelType> m_IndexToLabelMap;
 
         private:
           RFapply(const Self &); //purposely not implemented
+          /** Reads the forest once, every later stream division reuses it. */
+          void ReadForest();
+
+          /** Classifies the samples of features with the chosen evaluator. */
+          template< class FeaturesT, class PredictionsT >
+          void Predict(const FeaturesT & features, PredictionsT & predictions, ThreadIdType threadId);
+
           void operator=(const Self &);  //purposely not implemented
 
           std::vector<InputImagePointer> m_FeatureImages;
@@ -10,9 +10,13 @@
 #include "classification.h"
 #include "data.h"
 #include "forest.h"
+#include "compiledforest.h"
 
 #include <iostream>
 #include <ostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
  
 namespace itk
 {
@@ -21,6 +25,97 @@ namespace itk
     {
         m_nComp = 0;
         m_nClass = 0;
+        m_Evaluator = TreeEvaluator;
+        m_CheckEvaluator = false;
+        m_VoteMode = ExactVote;
+        m_ProbabilityOutput = false;
+        m_LeafOutput = false;
+        m_VoteSumOutput = false;
+        m_BackgroundLabel = 0;
+        m_ForegroundPixels = 0;
+        m_EarlyExit = false;
+        m_EarlyExitMargin = 0;
+        m_EarlyExitPixels = 0;
+
+        this->SetNumberOfRequiredOutputs(4);
+        this->SetNthOutput(1, this->MakeOutput(1));
+        this->SetNthOutput(2, this->MakeOutput(2));
+        this->SetNthOutput(3, this->MakeOutput(3));
+    }
+
+    template< class TImage>
+    DataObject::Pointer RFapply<TImage>::MakeOutput(DataObjectPointerArraySizeType idx)
+    {
+        if (idx == 1)
+        {
+            return ProbabilityImageType::New().GetPointer();
+        }
+        if (idx == 2)
+        {
+            return LeafImageType::New().GetPointer();
+        }
+        if (idx == 3)
+        {
+            return VoteSumImageType::New().GetPointer();
+        }
+        return Superclass::MakeOutput(idx);
+    }
+
+    template< class TImage>
+    typename RFapply<TImage>::ProbabilityImageType * RFapply<TImage>::GetProbabilityOutput()
+    {
+        return dynamic_cast<ProbabilityImageType *>(this->ProcessObject::GetOutput(1));
+    }
+
+    template< class TImage>
+    typename RFapply<TImage>::LeafImageType * RFapply<TImage>::GetLeafOutput()
+    {
+        return dynamic_cast<LeafImageType *>(this->ProcessObject::GetOutput(2));
+    }
+
+    template< class TImage>
+    typename RFapply<TImage>::VoteSumImageType * RFapply<TImage>::GetVoteSumOutput()
+    {
+        return dynamic_cast<VoteSumImageType *>(this->ProcessObject::GetOutput(3));
+    }
+
+    template< class TImage>
+    void RFapply<TImage>::GenerateOutputInformation()
+    {
+        Superclass::GenerateOutputInformation();
+        this->GetProbabilityOutput()->SetNumberOfComponentsPerPixel(m_nClass);
+        this->GetVoteSumOutput()->SetNumberOfComponentsPerPixel(m_nClass);
+
+        // A single component per pixel when the leaves are not kept
+        unsigned int nLeafComp = 1;
+        if (m_LeafOutput)
+        {
+            this->ReadForest();
+            nLeafComp = m_Forest->GetCompiledForest().TreeNum();
+        }
+        this->GetLeafOutput()->SetNumberOfComponentsPerPixel(nLeafComp);
+    }
+
+    template< class TImage>
+    void RFapply<TImage>::AllocateOutputs()
+    {
+        typedef ImageBase<TImage::ImageDimension> ImageBaseType;
+        const bool enabled[4] = {true, m_ProbabilityOutput, m_LeafOutput, m_VoteSumOutput};
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            ImageBaseType *outputPtr = dynamic_cast<ImageBaseType *>(this->ProcessObject::GetOutput(i));
+            if (enabled[i])
+            {
+                outputPtr->SetBufferedRegion(outputPtr->GetRequestedRegion());
+                outputPtr->Allocate();
+            }
+            else
+            {
+                // Releases the buffer of an earlier run, the buffered
+                // region is left empty
+                outputPtr->Initialize();
+            }
+        }
     }
 
     template< class TImage>
@@ -54,10 +149,179 @@ namespace itk
         m_nClass = nClass;
     }
 
+    template <class TImage>
+    void RFapply<TImage>::SetEvaluator(const EvaluatorType evaluator)
+    {
+        m_Evaluator = evaluator;
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetKernelFileName(const std::string kernelFileName)
+    {
+        if (kernelFileName != m_KernelFileName)
+        {
+            m_KernelFileName = kernelFileName;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetVoteMode(const VoteMode voteMode)
+    {
+        m_VoteMode = voteMode;
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetProbabilityOutput(const bool probabilityOutput)
+    {
+        if (probabilityOutput != m_ProbabilityOutput)
+        {
+            m_ProbabilityOutput = probabilityOutput;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetLeafOutput(const bool leafOutput)
+    {
+        if (leafOutput != m_LeafOutput)
+        {
+            m_LeafOutput = leafOutput;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetVoteSumOutput(const bool voteSumOutput)
+    {
+        if (voteSumOutput != m_VoteSumOutput)
+        {
+            m_VoteSumOutput = voteSumOutput;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetCachedVoteSums(const VoteSumImageType *voteSums)
+    {
+        this->ProcessObject::SetInput("cached_vote_sums", const_cast<VoteSumImageType *>(voteSums));
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetPreviousForestFileName(const std::string previousForestFileName)
+    {
+        if (previousForestFileName != m_PreviousForestFileName)
+        {
+            m_PreviousForestFileName = previousForestFileName;
+            m_PreviousForest = NULL;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetPreviousForest(RFforest *previousForest)
+    {
+        if (previousForest != m_PreviousForest.GetPointer())
+        {
+            m_PreviousForest = previousForest;
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetMaskImage(const MaskImageType *mask)
+    {
+        this->ProcessObject::SetInput("mask", const_cast<MaskImageType *>(mask));
+    }
+
+    template <class TImage>
+    const typename RFapply<TImage>::MaskImageType * RFapply<TImage>::GetMaskImage() const
+    {
+        return dynamic_cast<const MaskImageType *>(this->ProcessObject::GetInput("mask"));
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetBackgroundLabel(const int backgroundLabel)
+    {
+        m_BackgroundLabel = backgroundLabel;
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetFallbackLabels(const TImage *labels)
+    {
+        this->ProcessObject::SetInput("fallback_labels", const_cast<TImage *>(labels));
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetFallbackProbabilities(const ProbabilityImageType *probabilities)
+    {
+        this->ProcessObject::SetInput("fallback_probabilities", const_cast<ProbabilityImageType *>(probabilities));
+    }
+
+    template <class TImage>
+    SizeValueType RFapply<TImage>::GetForegroundPixels() const
+    {
+        return m_ForegroundPixels;
+    }
+
+    template <class TImage>
+    SizeValueType RFapply<TImage>::GetUpdatedTreeNum() const
+    {
+        return m_RemovedTrees.size() + m_AddedTrees.size();
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetEarlyExit(const bool earlyExit)
+    {
+        m_EarlyExit = earlyExit;
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetEarlyExitMargin(const double margin)
+    {
+        m_EarlyExitMargin = margin;
+    }
+
+    template <class TImage>
+    SizeValueType RFapply<TImage>::GetEarlyExitPixels() const
+    {
+        return m_EarlyExitPixels;
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetCheckEvaluator(const bool checkEvaluator)
+    {
+        m_CheckEvaluator = checkEvaluator;
+    }
+
     template <class TImage>
     void RFapply<TImage>::SetForestFileName(const std::string forestFileName)
     {
-        m_forestFileName = forestFileName;
+        if (forestFileName != m_forestFileName)
+        {
+            m_forestFileName = forestFileName;
+            m_Forest = NULL;
+            // the kernel indexes the leaf tables of the forest it was loaded for
+            m_Kernel.Unload();
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    void RFapply<TImage>::SetForest(RFforest *forest)
+    {
+        if (forest != m_Forest.GetPointer())
+        {
+            m_Forest = forest;
+            m_Kernel.Unload();
+            this->Modified();
+        }
+    }
+
+    template <class TImage>
+    RFforest * RFapply<TImage>::GetForest()
+    {
+        return m_Forest.GetPointer();
     }
 
     template <class TImage>
@@ -67,8 +331,10 @@ namespace itk
 
         for( itk::InputDataObjectIterator it(this); !it.IsAtEnd(); it++ )
         {
-            // Check whether the input is an image of the appropriate dimension
-            InputImageType *input = dynamic_cast<InputImageType*>(it.GetInput());
+            // The features, mask, fallbacks and cached vote sums all cover
+            // the pixels of the output
+            ImageBase<TImage::ImageDimension> *input =
+                dynamic_cast<ImageBase<TImage::ImageDimension>*>(it.GetInput());
             InputImageRegionType inputRegion;
             this->CallCopyOutputRegionToInputRegion(inputRegion, this->GetOutput()->GetRequestedRegion());
             input->SetRequestedRegion(inputRegion);
@@ -76,78 +342,281 @@ namespace itk
     }
 
     template< class TImage>
-    void RFapply<TImage>::GenerateData()
+    void RFapply<TImage>::ReadForest()
     {
-        // Set the testing sample data
-        unsigned long size_xy = (m_FeatureImages[0]->GetRequestedRegion().GetSize()[0])*
-                                (m_FeatureImages[0]->GetRequestedRegion().GetSize()[1]);
-        TestingDataType testData(size_xy, m_nComp);
+        if (m_Forest.IsNull())
+        {
+            m_Forest = RFforest::New();
+            m_Forest->Read(m_forestFileName);
+        }
+    }
 
-        // Fill in the testing sample data
-        typedef itk::ImageRegionConstIterator<TImage> ConstIteratorType;
-        for (int iComp = 0; iComp < m_nComp; iComp++)
+    template< class TImage>
+    void RFapply<TImage>::BeforeThreadedGenerateData()
+    {
+        this->ReadForest();
+        if ((m_Evaluator == KernelEvaluator) && (!m_Kernel.IsLoaded() || (m_Kernel.FileName() != m_KernelFileName)))
         {
-            unsigned long iTest = 0;
-            ConstIteratorType testIT(m_FeatureImages[iComp], m_FeatureImages[0]->GetRequestedRegion());
-            for (testIT.GoToBegin(); !testIT.IsAtEnd(); ++testIT)
+            try
             {
-                testData.data[iTest][iComp] = testIT.Get();
-                iTest++;
+                m_Kernel.Load(m_KernelFileName, m_Forest->GetCompiledForest());
             }
+            catch (std::runtime_error &error)
+            {
+                itkExceptionMacro(<< error.what());
+            }
+        }
+        if (m_LeafOutput && m_EarlyExit)
+        {
+            itkExceptionMacro(<< "The leaves of every tree are not known with early exit");
+        }
+        if (m_LeafOutput && (this->GetMaskImage() != NULL))
+        {
+            itkExceptionMacro(<< "The leaves of the pixels out of the mask are not known");
+        }
+        if (m_LeafOutput && (m_Forest->GetCompiledForest().MaxTreeLeafNum() > 65536))
+        {
+            itkExceptionMacro(<< "A tree of the forest has too many leaves to keep their indices");
+        }
+        if (m_VoteSumOutput && m_EarlyExit)
+        {
+            itkExceptionMacro(<< "The votes of every tree are not summed with early exit");
+        }
+        if (!VoteSumFits(m_VoteMode, m_Forest->GetCompiledForest().TreeNum()))
+        {
+            itkExceptionMacro(<< "The fixed16 votes of more than 65537 trees overflow");
         }
 
-        // Setup the forest
-        RandomForestType forest = RandomForestType(true);
+        // Compare the forests once, the trees to travel are the same for
+        // every stream division
+        m_RemovedTrees.clear();
+        m_AddedTrees.clear();
+        if (this->ProcessObject::GetInput("cached_vote_sums") != NULL)
+        {
+            if (m_EarlyExit || m_LeafOutput || (this->GetMaskImage() != NULL))
+            {
+                itkExceptionMacro(<< "Cached vote sums are updated without early exit, leaf output or mask");
+            }
+            if (m_PreviousForest.IsNull())
+            {
+                m_PreviousForest = RFforest::New();
+                m_PreviousForest->Read(m_PreviousForestFileName);
+            }
+            ClassificationType::ChangedTrees(m_PreviousForest->GetCompiledForest(), m_Forest->GetCompiledForest(),
+                                             m_RemovedTrees, m_AddedTrees);
+        }
 
-        // Read the forest from file
-        std::filebuf fb;
-        fb.open(m_forestFileName, std::ios::binary | std::ios::in);
-        if (fb.is_open())
+        // Generate index-to-label mapping based on nClass
+        m_IndexToLabelMap.clear();
+        for (int i = 0; i < m_nClass; i++)
         {
-            std::istream fin(&fb);
-            forest.Read(fin);
-            fb.close();
+            m_IndexToLabelMap.insert(std::map<index_t, int>::value_type(i, i));
         }
-        else
+
+        m_ThreadEarlyExitPixels.assign(this->GetNumberOfThreads(), 0);
+        m_ThreadForegroundPixels.assign(this->GetNumberOfThreads(), 0);
+    }
+
+    template< class TImage>
+    void RFapply<TImage>::AfterThreadedGenerateData()
+    {
+        // Counted over all stream divisions
+        for (unsigned int i = 0; i < m_ThreadEarlyExitPixels.size(); i++)
         {
-            std::cerr << "Error opening the file!" << std::endl;
+            m_EarlyExitPixels += m_ThreadEarlyExitPixels[i];
+            m_ForegroundPixels += m_ThreadForegroundPixels[i];
         }
+    }
 
-        // Setup soft predictions
-        typedef ClassificationType::SoftPredictionT SoftPredictionType;
-        SoftPredictionType softPrediction(size_xy, m_nClass);
+    template< class TImage>
+    void RFapply<TImage>::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                               ThreadIdType threadId)
+    {
+#ifdef _OPENMP
+        // Every ITK thread would otherwise start its own team of OpenMP
+        // threads over its tiles. Leave the OpenMP parallelism to a single
+        // ITK thread only.
+        if (this->GetNumberOfThreads() > 1)
+        {
+            omp_set_num_threads(1);
+        }
+#endif
 
-        // Setup hard predictions
-        typedef ClassificationType::HardPredictionT HardPredictionType;
-        HardPredictionType hardPrediction;
-        hardPrediction.Resize(size_xy);
+        // Read the features of this thread's (2D) region straight from the
+        // buffers of the feature images
+        const unsigned long width = outputRegionForThread.GetSize(0);
+        FeatureView<GreyType> features(width, outputRegionForThread.GetSize(1));
+        for (int iComp = 0; iComp < m_nComp; iComp++)
+        {
+            const TImage *image = m_FeatureImages[iComp];
+            features.AddFeature(image->GetBufferPointer() + image->ComputeOffset(outputRegionForThread.GetIndex()),
+                                image->GetBufferedRegion().GetSize(0));
+        }
 
-        // Generate index-to-label mapping based on nClass
-        std::map<std::size_t, LabelType> indexToLabelMap;
-        indexToLabelMap.clear();
-        for (int i = 0; i < m_nClass; i++)
+        // And write the hard and soft predictions straight into the outputs,
+        // the soft ones only when their output is enabled
+        TImage *output = this->GetOutput();
+        float *probabilities = NULL;
+        unsigned long probabilityRowStride = 0;
+        if (m_ProbabilityOutput)
         {
-            indexToLabelMap.insert(std::map<index_t, int>::value_type(i, i));
+            ProbabilityImageType *probabilityOutput = this->GetProbabilityOutput();
+            probabilities = probabilityOutput->GetBufferPointer()
+                            + probabilityOutput->ComputeOffset(outputRegionForThread.GetIndex()) * m_nClass;
+            probabilityRowStride = probabilityOutput->GetBufferedRegion().GetSize(0);
+        }
+        typedef PredictionView<typename TImage::PixelType, float> PredictionViewType;
+        PredictionViewType predictions(output->GetBufferPointer() + output->ComputeOffset(outputRegionForThread.GetIndex()),
+                                       output->GetBufferedRegion().GetSize(0),
+                                       probabilities, probabilityRowStride, width);
+        if (m_LeafOutput)
+        {
+            LeafImageType *leafOutput = this->GetLeafOutput();
+            predictions.SetLeafIndices(leafOutput->GetBufferPointer()
+                                       + leafOutput->ComputeOffset(outputRegionForThread.GetIndex())
+                                       * leafOutput->GetNumberOfComponentsPerPixel(),
+                                       leafOutput->GetBufferedRegion().GetSize(0));
+        }
+        if (m_VoteSumOutput)
+        {
+            VoteSumImageType *voteSumOutput = this->GetVoteSumOutput();
+            predictions.SetVoteSums(voteSumOutput->GetBufferPointer()
+                                    + voteSumOutput->ComputeOffset(outputRegionForThread.GetIndex()) * m_nClass,
+                                    voteSumOutput->GetBufferedRegion().GetSize(0));
         }
-        bool are_labels_valid = true;
 
         // Get hard predictions
-        classification.Predicting(forest, testData, are_labels_valid,
-                                  indexToLabelMap, softPrediction, hardPrediction);
-
-        // Reshape hard predictions into image
-        typename TImage::Pointer testResult = this->GetOutput();
-        testResult->SetRegions(m_FeatureImages[0]->GetRequestedRegion());
-        testResult->CopyInformation(m_FeatureImages[0]);
-        testResult->Allocate();
-
-        typedef itk::ImageRegionIterator<TImage> IteratorType;
-        IteratorType resultIT(testResult, testResult->GetRequestedRegion());
-        unsigned long k = 0;
-        for (resultIT.GoToBegin(); !resultIT.IsAtEnd(); ++resultIT)
-        {
-            testResult->SetPixel(resultIT.GetIndex(), hardPrediction[k]);
-            k++;
+        const VoteSumImageType *cachedVoteSums =
+            dynamic_cast<const VoteSumImageType *>(this->ProcessObject::GetInput("cached_vote_sums"));
+        const MaskImageType *mask = this->GetMaskImage();
+        if (cachedVoteSums != NULL)
+        {
+            if (cachedVoteSums->GetNumberOfComponentsPerPixel() != m_nClass)
+            {
+                itkExceptionMacro(<< "The cached vote sums have " << cachedVoteSums->GetNumberOfComponentsPerPixel()
+                                  << " components for " << m_nClass << " classes");
+            }
+            VoteSumView voteSums(cachedVoteSums->GetBufferPointer()
+                                 + cachedVoteSums->ComputeOffset(outputRegionForThread.GetIndex()) * m_nClass,
+                                 cachedVoteSums->GetBufferedRegion().GetSize(0),
+                                 width, outputRegionForThread.GetSize(1));
+            std::map<std::size_t, LabelType> indexToLabelMap = m_IndexToLabelMap;
+            bool are_labels_valid = true;
+            m_ThreadForegroundPixels[threadId] = features.Size();
+            classification.PredictingUpdate(m_PreviousForest->GetCompiledForest(), m_RemovedTrees,
+                                            m_Forest->GetCompiledForest(), m_AddedTrees,
+                                            features, voteSums, are_labels_valid,
+                                            indexToLabelMap, predictions, m_VoteMode);
+        }
+        else if (mask != NULL)
+        {
+            // Only the pixels of the mask are classified, the others get
+            // the background label (or the fallback one), no probability
+            // (or the fallback ones) and no votes. Leaf indices are not
+            // kept with a mask (see BeforeThreadedGenerateData)
+            std::vector<double> none(m_nClass, 0.0);
+            std::vector<index_t> samples;
+            const typename MaskImageType::PixelType *maskRow =
+                mask->GetBufferPointer() + mask->ComputeOffset(outputRegionForThread.GetIndex());
+            const TImage *fallbackLabels =
+                dynamic_cast<const TImage *>(this->ProcessObject::GetInput("fallback_labels"));
+            const ProbabilityImageType *fallbackProbabilities =
+                dynamic_cast<const ProbabilityImageType *>(this->ProcessObject::GetInput("fallback_probabilities"));
+            if ((fallbackProbabilities != NULL) && (fallbackProbabilities->GetNumberOfComponentsPerPixel() != m_nClass))
+            {
+                itkExceptionMacro(<< "The fallback probabilities have "
+                                  << fallbackProbabilities->GetNumberOfComponentsPerPixel()
+                                  << " components for " << m_nClass << " classes");
+            }
+            std::vector<double> fallback(m_nClass, 0.0);
+            const unsigned long height = outputRegionForThread.GetSize(1);
+            for (unsigned long y = 0; y < height; y++)
+            {
+                for (unsigned long x = 0; x < width; x++)
+                {
+                    index_t i = y * width + x;
+                    if (maskRow[x] != 0)
+                    {
+                        samples.push_back(i);
+                        continue;
+                    }
+                    InputImageIndexType index = outputRegionForThread.GetIndex();
+                    index[0] += x;
+                    index[1] += y;
+                    if (fallbackProbabilities != NULL)
+                    {
+                        const float *p = fallbackProbabilities->GetBufferPointer()
+                                         + fallbackProbabilities->ComputeOffset(index) * m_nClass;
+                        std::copy(p, p + m_nClass, fallback.begin());
+                    }
+                    predictions.Store(i, (fallbackProbabilities != NULL) ? &fallback[0] : &none[0], m_nClass,
+                                      (fallbackLabels != NULL) ? fallbackLabels->GetPixel(index) : m_BackgroundLabel);
+                    predictions.StoreVoteSums(i, 1, m_nClass, &none[0]);
+                }
+                maskRow += mask->GetBufferedRegion().GetSize(0);
+            }
+            m_ThreadForegroundPixels[threadId] = samples.size();
+
+            MaskedFeatures<FeatureView<GreyType>, GreyType> maskedFeatures(features, samples);
+            MaskedPredictions<PredictionViewType> maskedPredictions(predictions, samples);
+            this->Predict(maskedFeatures, maskedPredictions, threadId);
+        }
+        else
+        {
+            m_ThreadForegroundPixels[threadId] = features.Size();
+            this->Predict(features, predictions, threadId);
+        }
+    }
+
+    template< class TImage>
+    template< class FeaturesT, class PredictionsT>
+    void RFapply<TImage>::Predict(const FeaturesT & features, PredictionsT & predictions,
+                                  ThreadIdType threadId)
+    {
+        // The mapping is only read, each thread works on its own copy
+        std::map<std::size_t, LabelType> indexToLabelMap = m_IndexToLabelMap;
+        bool are_labels_valid = true;
+
+        if (m_EarlyExit)
+        {
+            m_ThreadEarlyExitPixels[threadId] =
+                classification.PredictingEarlyExit(m_Forest->GetCompiledForest(), features,
+                                                   are_labels_valid, indexToLabelMap,
+                                                   predictions, m_EarlyExitMargin);
+        }
+        else if (m_Evaluator == QuickScorerEvaluator)
+        {
+            const QuickScorerType &scorer = m_Forest->GetQuickScorer();
+            classification.PredictingBlocks(scorer, features, are_labels_valid,
+                                            indexToLabelMap, predictions, m_VoteMode);
+            if (m_CheckEvaluator)
+            {
+                // The check walks the original trees, which read MLData rows
+                unsigned long size_xy = features.Size();
+                TestingDataType testData(size_xy, m_nComp);
+                std::vector<GreyType> row(m_nComp);
+                for (unsigned long i = 0; i < size_xy; i++)
+                {
+                    features.Gather(i, 1, &row[0]);
+                    std::copy(row.begin(), row.end(), testData.data[i].begin());
+                }
+                size_t mismatch = CheckQuickScorer(m_Forest->GetForest(), scorer, testData);
+                if (mismatch != 0)
+                {
+                    itkExceptionMacro(<< "QuickScorer disagrees with DecisionTree::Apply on "
+                                      << mismatch << " tree leaves");
+                }
+            }
+        }
+        else if (m_Evaluator == KernelEvaluator)
+        {
+            classification.PredictingBlocks(m_Kernel, features, are_labels_valid,
+                                            indexToLabelMap, predictions, m_VoteMode);
+        }
+        else
+        {
+            classification.PredictingBlocks(m_Forest->GetCompiledForest(), features, are_labels_valid,
+                                            indexToLabelMap, predictions, m_VoteMode);
         }
     }
 } // end namespace
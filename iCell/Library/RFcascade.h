@@ -0,0 +1,112 @@
+#ifndef __RFcascade_h
+#define __RFcascade_h
+
+#include "itkImageToImageFilter.h"
+#include "itkTimeStamp.h"
+
+#include <vector>
+
+namespace itk
+{
+    /** The coarse step of a coarse-to-fine classification: from the labels
+     *  and probabilities of a downsampled image, classified with a forest
+     *  trained at that scale, masks the pixels of the full resolution image
+     *  to classify again. A coarse pixel is refined when its largest class
+     *  probability is below the confidence, or when a coarse pixel within
+     *  the boundary radius has another label. Every full resolution pixel
+     *  takes the flag, label and probabilities of the coarse pixel it lies
+     *  in (output 0, 1 and 2), so RFapply classifies the mask and falls
+     *  back to the coarse predictions elsewhere. Works on any requested
+     *  region, so it streams with the tiles of RFapply. */
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    class RFcascade : public ImageToImageFilter< TLabelImage, TMaskImage >
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFcascade Self;
+          typedef ImageToImageFilter< TLabelImage, TMaskImage > Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+          typedef ImageBase<TLabelImage::ImageDimension> ImageBaseType;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFcascade, ImageToImageFilter);
+
+          /** The coarse labels are the input, their probabilities the
+           *  second input **/
+          void SetProbabilityImage(const TProbabilityImage *probabilities);
+          const TProbabilityImage * GetProbabilityImage() const;
+
+          /** The geometry of the full resolution image, as
+           *  ResampleImageFilter's **/
+          void SetOutputParametersFromImage(const ImageBaseType *image);
+
+          /** Coarse pixels within this distance of another label are refined **/
+          itkSetMacro(BoundaryRadius, unsigned int);
+          itkGetConstMacro(BoundaryRadius, unsigned int);
+
+          /** Coarse pixels with a largest class probability below this are
+           *  refined **/
+          itkSetMacro(Confidence, double);
+          itkGetConstMacro(Confidence, double);
+
+          /** The second output: the coarse labels at full resolution **/
+          TLabelImage * GetLabelOutput();
+
+          /** The third output: the coarse probabilities at full resolution **/
+          TProbabilityImage * GetProbabilityOutput();
+
+        protected:
+          RFcascade();
+          ~RFcascade(){}
+
+          /** Makes the label image for output 1 and the probability image
+           *  for output 2. */
+          typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+          using Superclass::MakeOutput;
+          virtual DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx);
+
+          /** Gives every output the full resolution geometry and one
+           *  probability component per class. */
+          virtual void GenerateOutputInformation();
+
+          /** The coarse images are needed whole, whatever region is requested. */
+          virtual void GenerateInputRequestedRegion();
+
+          /** Flags the coarse pixels to refine, once per coarse classification. */
+          virtual void BeforeThreadedGenerateData();
+
+          /** Upsamples the flags, labels and probabilities of one thread's region. */
+          virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                            ThreadIdType threadId);
+
+        private:
+          RFcascade(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+
+          unsigned int m_BoundaryRadius;
+          double m_Confidence;
+
+          typename TMaskImage::PointType m_OutputOrigin;
+          typename TMaskImage::SpacingType m_OutputSpacing;
+          typename TMaskImage::DirectionType m_OutputDirection;
+          typename TMaskImage::RegionType m_OutputRegion;
+
+          /** Refine flag of every coarse pixel, in buffer order **/
+          std::vector<unsigned char> m_Refine;
+          TimeStamp m_RefineTime;
+    };
+
+} //namespace ITK
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RFcascade.txx"
+#endif
+
+
+#endif // __RFcascade_h
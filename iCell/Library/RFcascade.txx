@@ -0,0 +1,200 @@
+#ifndef __RFcascade_txx
+#define __RFcascade_txx
+
+#include "RFcascade.h"
+
+#include "itkObjectFactory.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+
+namespace itk
+{
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::RFcascade()
+    {
+        m_BoundaryRadius = 1;
+        m_Confidence = 0.6;
+        m_OutputOrigin.Fill(0);
+        m_OutputSpacing.Fill(1);
+        m_OutputDirection.SetIdentity();
+
+        this->SetNumberOfRequiredOutputs(3);
+        this->SetNthOutput(1, this->MakeOutput(1));
+        this->SetNthOutput(2, this->MakeOutput(2));
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    DataObject::Pointer
+    RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::MakeOutput(DataObjectPointerArraySizeType idx)
+    {
+        if (idx == 1)
+        {
+            return TLabelImage::New().GetPointer();
+        }
+        if (idx == 2)
+        {
+            return TProbabilityImage::New().GetPointer();
+        }
+        return Superclass::MakeOutput(idx);
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    TLabelImage * RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::GetLabelOutput()
+    {
+        return dynamic_cast<TLabelImage *>(this->ProcessObject::GetOutput(1));
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    TProbabilityImage * RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::GetProbabilityOutput()
+    {
+        return dynamic_cast<TProbabilityImage *>(this->ProcessObject::GetOutput(2));
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::SetProbabilityImage(const TProbabilityImage *probabilities)
+    {
+        this->ProcessObject::SetInput("coarse_probabilities", const_cast<TProbabilityImage *>(probabilities));
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    const TProbabilityImage * RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::GetProbabilityImage() const
+    {
+        return dynamic_cast<const TProbabilityImage *>(this->ProcessObject::GetInput("coarse_probabilities"));
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::SetOutputParametersFromImage(const ImageBaseType *image)
+    {
+        m_OutputOrigin = image->GetOrigin();
+        m_OutputSpacing = image->GetSpacing();
+        m_OutputDirection = image->GetDirection();
+        m_OutputRegion = image->GetLargestPossibleRegion();
+        this->Modified();
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::GenerateOutputInformation()
+    {
+        Superclass::GenerateOutputInformation();
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            ImageBaseType *output = dynamic_cast<ImageBaseType *>(this->ProcessObject::GetOutput(i));
+            output->SetLargestPossibleRegion(m_OutputRegion);
+            output->SetOrigin(m_OutputOrigin);
+            output->SetSpacing(m_OutputSpacing);
+            output->SetDirection(m_OutputDirection);
+        }
+        const TProbabilityImage *probabilities = this->GetProbabilityImage();
+        if (probabilities != NULL)
+        {
+            this->GetProbabilityOutput()->SetNumberOfComponentsPerPixel(probabilities->GetNumberOfComponentsPerPixel());
+        }
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::GenerateInputRequestedRegion()
+    {
+        Superclass::GenerateInputRequestedRegion();
+        const_cast<TLabelImage *>(this->GetInput())->SetRequestedRegionToLargestPossibleRegion();
+        const_cast<TProbabilityImage *>(this->GetProbabilityImage())->SetRequestedRegionToLargestPossibleRegion();
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::BeforeThreadedGenerateData()
+    {
+        const TLabelImage *labels = this->GetInput();
+        const TProbabilityImage *probabilities = this->GetProbabilityImage();
+        if (probabilities == NULL)
+        {
+            itkExceptionMacro(<< "The coarse probabilities are not set");
+        }
+        if (probabilities->GetBufferedRegion() != labels->GetBufferedRegion())
+        {
+            itkExceptionMacro(<< "The coarse labels and probabilities cover different regions");
+        }
+
+        // Every tile of the full resolution image asks for the mask, the
+        // flags are only computed again when the coarse images change
+        ModifiedTimeType inputTime = std::max(labels->GetMTime(), probabilities->GetMTime());
+        if (!m_Refine.empty() && (m_RefineTime.GetMTime() > std::max(inputTime, this->GetMTime())))
+        {
+            return;
+        }
+
+        const long width = labels->GetBufferedRegion().GetSize(0);
+        const long height = labels->GetBufferedRegion().GetSize(1);
+        const long radius = m_BoundaryRadius;
+        const unsigned int nClass = probabilities->GetNumberOfComponentsPerPixel();
+        const typename TLabelImage::PixelType *label = labels->GetBufferPointer();
+        const typename TProbabilityImage::InternalPixelType *probability = probabilities->GetBufferPointer();
+        m_Refine.assign(width * height, 0);
+        for (long y = 0; y < height; y++)
+        {
+            for (long x = 0; x < width; x++)
+            {
+                const long i = y * width + x;
+                const typename TProbabilityImage::InternalPixelType *p = probability + i * nClass;
+                if (*std::max_element(p, p + nClass) < m_Confidence)
+                {
+                    m_Refine[i] = 1;
+                    continue;
+                }
+                for (long v = std::max(0L, y - radius); (v <= std::min(height - 1, y + radius)) && !m_Refine[i]; v++)
+                {
+                    for (long u = std::max(0L, x - radius); u <= std::min(width - 1, x + radius); u++)
+                    {
+                        if (label[v * width + u] != label[i])
+                        {
+                            m_Refine[i] = 1;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        m_RefineTime.Modified();
+    }
+
+    template< class TLabelImage, class TProbabilityImage, class TMaskImage >
+    void RFcascade<TLabelImage, TProbabilityImage, TMaskImage>::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                                                                   ThreadIdType threadId)
+    {
+        const TLabelImage *labels = this->GetInput();
+        const TProbabilityImage *probabilities = this->GetProbabilityImage();
+        const typename TLabelImage::RegionType coarseRegion = labels->GetBufferedRegion();
+        const unsigned int nClass = probabilities->GetNumberOfComponentsPerPixel();
+
+        TMaskImage *maskOutput = this->GetOutput();
+        TLabelImage *labelOutput = this->GetLabelOutput();
+        TProbabilityImage *probabilityOutput = this->GetProbabilityOutput();
+
+        typedef ImageRegionIteratorWithIndex<TMaskImage> IteratorType;
+        IteratorType maskIT(maskOutput, outputRegionForThread);
+        for (maskIT.GoToBegin(); !maskIT.IsAtEnd(); ++maskIT)
+        {
+            // The coarse pixel the full resolution pixel lies in, the
+            // nearest one on the border
+            typename TMaskImage::PointType point;
+            maskOutput->TransformIndexToPhysicalPoint(maskIT.GetIndex(), point);
+            typename TLabelImage::IndexType coarseIndex;
+            labels->TransformPhysicalPointToIndex(point, coarseIndex);
+            for (unsigned int d = 0; d < TLabelImage::ImageDimension; d++)
+            {
+                coarseIndex[d] = std::max(coarseIndex[d], coarseRegion.GetIndex(d));
+                coarseIndex[d] = std::min<IndexValueType>(coarseIndex[d],
+                                                          coarseRegion.GetIndex(d) + coarseRegion.GetSize(d) - 1);
+            }
+            const OffsetValueType coarseOffset = labels->ComputeOffset(coarseIndex);
+
+            maskIT.Set(m_Refine[coarseOffset]);
+            labelOutput->SetPixel(maskIT.GetIndex(), labels->GetBufferPointer()[coarseOffset]);
+            std::copy(probabilities->GetBufferPointer() + coarseOffset * nClass,
+                      probabilities->GetBufferPointer() + (coarseOffset + 1) * nClass,
+                      probabilityOutput->GetBufferPointer()
+                      + probabilityOutput->ComputeOffset(maskIT.GetIndex()) * nClass);
+        }
+    }
+} // end namespace
+
+#endif
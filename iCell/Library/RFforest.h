@@ -0,0 +1,85 @@
+#ifndef __RFforest_h
+#define __RFforest_h
+
+#include "itkLightObject.h"
+#include "itkObjectFactory.h"
+
+#include "classification.h"
+#include "forest.h"
+#include "compiledforest.h"
+#include "quickscorer.h"
+
+#include <fstream>
+#include <string>
+
+namespace itk
+{
+    /** A random forest read once from its binary file, together with the
+     *  compiled and QuickScorer forms used for inference. Once read it is
+     *  never modified, so one instance can be shared by several filters,
+     *  stream divisions and threads. */
+    class RFforest : public LightObject
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFforest Self;
+          typedef LightObject Superclass;
+          typedef SmartPointer< Self > Pointer;
+          typedef SmartPointer< const Self > ConstPointer;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFforest, LightObject);
+
+          typedef float GreyType;
+          typedef float LabelType;
+          typedef Histogram<GreyType, LabelType> RFHistogramType;
+          typedef AxisAlignedClassifier<GreyType, LabelType> RFAxisClassifierType;
+          typedef DecisionForest<RFHistogramType, RFAxisClassifierType, GreyType> RandomForestType;
+          typedef CompiledForest<GreyType> CompiledForestType;
+          typedef QuickScorer<GreyType> QuickScorerType;
+
+          /** Read the forest binary file and build its inference forms **/
+          void Read(const std::string forestFileName)
+          {
+              std::filebuf fb;
+              fb.open(forestFileName.c_str(), std::ios::binary | std::ios::in);
+              if (!fb.is_open())
+              {
+                  itkExceptionMacro(<< "Error opening the forest file " << forestFileName);
+              }
+              std::istream fin(&fb);
+              m_Forest.Read(fin);
+              fb.close();
+
+              m_CompiledForest.Build(m_Forest);
+              m_QuickScorer.Build(m_CompiledForest);
+          }
+
+          /** The forest as trained, its nodes must not be modified **/
+          RandomForestType & GetForest() { return m_Forest; }
+
+          /** The flattened forest used by the tree evaluator **/
+          const CompiledForestType & GetCompiledForest() const { return m_CompiledForest; }
+
+          /** The QuickScorer evaluator built on the compiled forest **/
+          const QuickScorerType & GetQuickScorer() const { return m_QuickScorer; }
+
+        protected:
+          RFforest(): m_Forest(true) {}
+          ~RFforest(){}
+
+        private:
+          RFforest(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+
+          RandomForestType m_Forest;
+          CompiledForestType m_CompiledForest;
+          QuickScorerType m_QuickScorer;
+    };
+
+} //namespace ITK
+
+#endif // __RFforest_h
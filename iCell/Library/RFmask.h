@@ -0,0 +1,57 @@
+#ifndef __RFmask_h
+#define __RFmask_h
+
+#include "itkImageToImageFilter.h"
+#include "itkObjectFactory.h"
+
+namespace itk
+{
+    /** A cheap foreground mask of a brightfield color image: tissue absorbs
+     *  light, so a pixel whose mean channel value is below the threshold is
+     *  foreground (1) and the bright glass around it background (0). Works
+     *  on any requested region, so it streams with the tiles of RFapply. */
+    template< class TInputImage, class TMaskImage >
+    class RFmask : public ImageToImageFilter< TInputImage, TMaskImage >
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFmask Self;
+          typedef ImageToImageFilter< TInputImage, TMaskImage > Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFmask, ImageToImageFilter);
+
+          /** Mean channel value below which a pixel is foreground **/
+          itkSetMacro(Threshold, double);
+          itkGetConstMacro(Threshold, double);
+
+        protected:
+          RFmask(){ m_Threshold = 220; }
+          ~RFmask(){}
+
+          /** Thresholds one thread's region. */
+          virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                            ThreadIdType threadId);
+
+        private:
+          RFmask(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+
+          double m_Threshold;
+    };
+
+} //namespace ITK
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RFmask.txx"
+#endif
+
+
+#endif // __RFmask_h
@@ -0,0 +1,35 @@
+#ifndef __RFmask_txx
+#define __RFmask_txx
+
+#include "RFmask.h"
+
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+namespace itk
+{
+    template< class TInputImage, class TMaskImage >
+    void RFmask<TInputImage, TMaskImage>::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                                               ThreadIdType threadId)
+    {
+        typedef itk::ImageRegionConstIterator<TInputImage> ConstIteratorType;
+        typedef itk::ImageRegionIterator<TMaskImage> IteratorType;
+        ConstIteratorType inputIT(this->GetInput(), outputRegionForThread);
+        IteratorType outputIT(this->GetOutput(), outputRegionForThread);
+
+        const unsigned int nComp = TInputImage::PixelType::Dimension;
+        const double sumThreshold = m_Threshold * nComp;
+        for (inputIT.GoToBegin(), outputIT.GoToBegin(); !inputIT.IsAtEnd(); ++inputIT, ++outputIT)
+        {
+            typename TInputImage::PixelType color = inputIT.Get();
+            double sum = 0;
+            for (unsigned int j = 0; j < nComp; j++)
+            {
+                sum += color[j];
+            }
+            outputIT.Set(sum < sumThreshold);
+        }
+    }
+} // end namespace
+
+#endif
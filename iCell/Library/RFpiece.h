@@ -0,0 +1,58 @@
+#ifndef __RFpiece_h
+#define __RFpiece_h
+
+#include "itkImageSource.h"
+#include "itkObjectFactory.h"
+
+namespace itk
+{
+    /** Gives a piece of an image, held in memory, to an ImageFileWriter
+     *  pasting it into a file with SetIORegion. The piece has the geometry
+     *  of the whole image (its largest possible region) and only buffers
+     *  the pasted region; an image without a source would be taken as
+     *  spanning its buffer only. */
+    template< class TImage >
+    class RFpiece : public ImageSource< TImage >
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFpiece Self;
+          typedef ImageSource< TImage > Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFpiece, ImageSource);
+
+          /** The piece, set again whenever its pixels change **/
+          void SetPiece(TImage *piece);
+
+        protected:
+          RFpiece(){}
+          ~RFpiece(){}
+
+          /** Gives the output the geometry of the whole image. */
+          virtual void GenerateOutputInformation();
+
+          /** The output is the piece itself, the requested region must lie
+           *  in its buffer. */
+          virtual void GenerateData();
+
+        private:
+          RFpiece(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+
+          typename TImage::Pointer m_Piece;
+    };
+
+} //namespace ITK
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RFpiece.txx"
+#endif
+
+
+#endif // __RFpiece_h
@@ -0,0 +1,37 @@
+#ifndef __RFpiece_txx
+#define __RFpiece_txx
+
+#include "RFpiece.h"
+
+namespace itk
+{
+    template< class TImage >
+    void RFpiece<TImage>::SetPiece(TImage *piece)
+    {
+        m_Piece = piece;
+        this->Modified();
+    }
+
+    template< class TImage >
+    void RFpiece<TImage>::GenerateOutputInformation()
+    {
+        if (m_Piece.IsNull())
+        {
+            itkExceptionMacro(<< "The piece is not set");
+        }
+        this->GetOutput()->CopyInformation(m_Piece);
+        this->GetOutput()->SetNumberOfComponentsPerPixel(m_Piece->GetNumberOfComponentsPerPixel());
+    }
+
+    template< class TImage >
+    void RFpiece<TImage>::GenerateData()
+    {
+        if (!m_Piece->GetBufferedRegion().IsInside(this->GetOutput()->GetRequestedRegion()))
+        {
+            itkExceptionMacro(<< "The requested region is not in the piece");
+        }
+        this->GraftOutput(m_Piece);
+    }
+} // end namespace
+
+#endif
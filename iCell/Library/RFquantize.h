@@ -0,0 +1,53 @@
+#ifndef __RFquantize_h
+#define __RFquantize_h
+
+#include "itkImageToImageFilter.h"
+#include "itkObjectFactory.h"
+
+namespace itk
+{
+    /** Turns per-class probabilities in [0, 1] into 8-bit values, 255 being
+     *  a probability of 1. Works on any requested region, so it streams with
+     *  the probability output of RFapply. */
+    template< class TInputImage, class TOutputImage >
+    class RFquantize : public ImageToImageFilter< TInputImage, TOutputImage >
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFquantize Self;
+          typedef ImageToImageFilter< TInputImage, TOutputImage > Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFquantize, ImageToImageFilter);
+
+        protected:
+          RFquantize(){}
+          ~RFquantize(){}
+
+          /** Keeps the number of components of the input. */
+          virtual void GenerateOutputInformation();
+
+          /** Scales and rounds one thread's region. */
+          virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                            ThreadIdType threadId);
+
+        private:
+          RFquantize(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+    };
+
+} //namespace ITK
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RFquantize.txx"
+#endif
+
+
+#endif // __RFquantize_h
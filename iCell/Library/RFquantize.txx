@@ -0,0 +1,44 @@
+#ifndef __RFquantize_txx
+#define __RFquantize_txx
+
+#include "RFquantize.h"
+
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+#include <math.h>
+
+namespace itk
+{
+    template< class TInputImage, class TOutputImage >
+    void RFquantize<TInputImage, TOutputImage>::GenerateOutputInformation()
+    {
+        Superclass::GenerateOutputInformation();
+        this->GetOutput()->SetNumberOfComponentsPerPixel(this->GetInput()->GetNumberOfComponentsPerPixel());
+    }
+
+    template< class TInputImage, class TOutputImage >
+    void RFquantize<TInputImage, TOutputImage>::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                                                     ThreadIdType threadId)
+    {
+        typedef itk::ImageRegionConstIterator<TInputImage> ConstIteratorType;
+        typedef itk::ImageRegionIterator<TOutputImage> IteratorType;
+        ConstIteratorType inputIT(this->GetInput(), outputRegionForThread);
+        IteratorType outputIT(this->GetOutput(), outputRegionForThread);
+
+        unsigned int nComp = this->GetInput()->GetNumberOfComponentsPerPixel();
+        typename TOutputImage::PixelType quantized(nComp);
+        for (inputIT.GoToBegin(), outputIT.GoToBegin(); !inputIT.IsAtEnd(); ++inputIT, ++outputIT)
+        {
+            typename TInputImage::PixelType probability = inputIT.Get();
+            for (unsigned int j = 0; j < nComp; j++)
+            {
+                double value = floor(probability[j] * 255.0 + 0.5);
+                quantized[j] = (value < 0) ? 0 : ((value > 255) ? 255 : value);
+            }
+            outputIT.Set(quantized);
+        }
+    }
+} // end namespace
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef __RFrepredict_h
+#define __RFrepredict_h
+
+#include "itkImageToImageFilter.h"
+#include "itkVectorImage.h"
+
+#include "classification.h"
+#include "featureview.h"
+#include "RFforest.h"
+
+#include <map>
+#include <string>
+
+namespace itk
+{
+    /** Predicts labels and per-class probabilities again from the leaf
+     *  indices kept by RFapply (its leaf output), without computing any
+     *  feature. The forest must have the same trees as the one that gave the
+     *  leaves; only its leaf statistics may differ, for instance after a
+     *  recalibration. Leaf indices beyond a tree's leaves raise an exception. */
+    template< class TLeafImage, class TLabelImage >
+    class RFrepredict : public ImageToImageFilter< TLeafImage, TLabelImage >
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFrepredict Self;
+          typedef ImageToImageFilter< TLeafImage, TLabelImage > Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+
+          /** Per-class probabilities of every pixel, as RFapply's **/
+          typedef VectorImage<float, TLabelImage::ImageDimension> ProbabilityImageType;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFrepredict, ImageToImageFilter);
+
+          /** The forest binary filename, read once on first execution.*/
+          void SetForestFileName(const std::string forestFileName);
+
+          /** An already loaded forest, shared instead of reading the file.*/
+          void SetForest(RFforest *forest);
+
+          /** The number of classes **/
+          void SetNClass(const unsigned short nClass);
+
+          /** How leaf votes are summed, see RFapply **/
+          void SetVoteMode(const VoteMode voteMode);
+
+          /** The second output: per-class probabilities **/
+          ProbabilityImageType * GetProbabilityOutput();
+
+        protected:
+          RFrepredict();
+          ~RFrepredict(){}
+
+          /** Makes the probability image for output 1. */
+          typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+          using Superclass::MakeOutput;
+          virtual DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx);
+
+          /** Sets one probability component per class. */
+          virtual void GenerateOutputInformation();
+
+          /** Reads the forest and checks it has one tree per leaf component. */
+          virtual void BeforeThreadedGenerateData();
+
+          /** Votes the cached leaves of one thread's output region. */
+          virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                            ThreadIdType threadId);
+
+          typedef RFforest::GreyType GreyType;
+          typedef RFforest::LabelType LabelType;
+          typedef Classification<GreyType, LabelType, RFforest::RFAxisClassifierType> ClassificationType;
+          ClassificationType classification;
+
+          std::string m_forestFileName;
+          RFforest::Pointer m_Forest;
+          unsigned short m_nClass;
+          VoteMode m_VoteMode;
+          std::map<std::size_t, LabelType> m_IndexToLabelMap;
+
+        private:
+          RFrepredict(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+    };
+
+} //namespace ITK
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RFrepredict.txx"
+#endif
+
+
+#endif // __RFrepredict_h
@@ -0,0 +1,155 @@
+#ifndef __RFrepredict_txx
+#define __RFrepredict_txx
+
+#include "RFrepredict.h"
+
+#include "itkObjectFactory.h"
+
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace itk
+{
+    template< class TLeafImage, class TLabelImage >
+    RFrepredict<TLeafImage, TLabelImage>::RFrepredict()
+    {
+        m_nClass = 0;
+        m_VoteMode = ExactVote;
+
+        this->SetNumberOfRequiredOutputs(2);
+        this->SetNthOutput(1, this->MakeOutput(1));
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    DataObject::Pointer RFrepredict<TLeafImage, TLabelImage>::MakeOutput(DataObjectPointerArraySizeType idx)
+    {
+        if (idx == 1)
+        {
+            return ProbabilityImageType::New().GetPointer();
+        }
+        return Superclass::MakeOutput(idx);
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    typename RFrepredict<TLeafImage, TLabelImage>::ProbabilityImageType *
+    RFrepredict<TLeafImage, TLabelImage>::GetProbabilityOutput()
+    {
+        return dynamic_cast<ProbabilityImageType *>(this->ProcessObject::GetOutput(1));
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::SetForestFileName(const std::string forestFileName)
+    {
+        if (forestFileName != m_forestFileName)
+        {
+            m_forestFileName = forestFileName;
+            m_Forest = NULL;
+            this->Modified();
+        }
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::SetForest(RFforest *forest)
+    {
+        if (forest != m_Forest.GetPointer())
+        {
+            m_Forest = forest;
+            this->Modified();
+        }
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::SetNClass(const unsigned short nClass)
+    {
+        m_nClass = nClass;
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::SetVoteMode(const VoteMode voteMode)
+    {
+        m_VoteMode = voteMode;
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::GenerateOutputInformation()
+    {
+        Superclass::GenerateOutputInformation();
+        this->GetProbabilityOutput()->SetNumberOfComponentsPerPixel(m_nClass);
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::BeforeThreadedGenerateData()
+    {
+        // Read the forest once, every later stream division reuses it
+        if (m_Forest.IsNull())
+        {
+            m_Forest = RFforest::New();
+            m_Forest->Read(m_forestFileName);
+        }
+        if (this->GetInput()->GetNumberOfComponentsPerPixel() != m_Forest->GetCompiledForest().TreeNum())
+        {
+            itkExceptionMacro(<< "The leaf image has " << this->GetInput()->GetNumberOfComponentsPerPixel()
+                              << " components but the forest has "
+                              << m_Forest->GetCompiledForest().TreeNum() << " trees");
+        }
+        if (!VoteSumFits(m_VoteMode, m_Forest->GetCompiledForest().TreeNum()))
+        {
+            itkExceptionMacro(<< "The fixed16 votes of more than 65537 trees overflow");
+        }
+
+        m_IndexToLabelMap.clear();
+        for (int i = 0; i < m_nClass; i++)
+        {
+            m_IndexToLabelMap.insert(std::map<index_t, int>::value_type(i, i));
+        }
+    }
+
+    template< class TLeafImage, class TLabelImage >
+    void RFrepredict<TLeafImage, TLabelImage>::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                                                                    ThreadIdType threadId)
+    {
+#ifdef _OPENMP
+        // As in RFapply, only a single ITK thread starts OpenMP threads
+        if (this->GetNumberOfThreads() > 1)
+        {
+            omp_set_num_threads(1);
+        }
+#endif
+
+        const RFforest::CompiledForestType &forest = m_Forest->GetCompiledForest();
+        const TLeafImage *input = this->GetInput();
+        const unsigned long width = outputRegionForThread.GetSize(0);
+        LeafIndexView leaves(input->GetBufferPointer()
+                             + input->ComputeOffset(outputRegionForThread.GetIndex()) * forest.TreeNum(),
+                             input->GetBufferedRegion().GetSize(0),
+                             width, outputRegionForThread.GetSize(1),
+                             &forest.leafBegin_[0], forest.TreeNum());
+
+        TLabelImage *output = this->GetOutput();
+        ProbabilityImageType *probabilityOutput = this->GetProbabilityOutput();
+        typedef PredictionView<typename TLabelImage::PixelType, float> PredictionViewType;
+        PredictionViewType predictions(output->GetBufferPointer() + output->ComputeOffset(outputRegionForThread.GetIndex()),
+                                       output->GetBufferedRegion().GetSize(0),
+                                       probabilityOutput->GetBufferPointer()
+                                       + probabilityOutput->ComputeOffset(outputRegionForThread.GetIndex()) * m_nClass,
+                                       probabilityOutput->GetBufferedRegion().GetSize(0),
+                                       width);
+
+        std::map<std::size_t, LabelType> indexToLabelMap = m_IndexToLabelMap;
+        bool are_labels_valid = true;
+        try
+        {
+            classification.PredictingCachedLeaves(forest, leaves, are_labels_valid,
+                                                  indexToLabelMap, predictions, m_VoteMode);
+        }
+        catch (std::runtime_error &error)
+        {
+            itkExceptionMacro(<< error.what());
+        }
+    }
+} // end namespace
+
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef __RFtiff_h
+#define __RFtiff_h
+
+#include "itkImageIOBase.h"
+#include "itkObjectFactory.h"
+#include "itk_tiff.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+    /** Reads the first (full resolution) image of a tiled TIFF, such as a
+     *  pyramidal whole slide, one requested region at a time: only the
+     *  native tiles the region overlaps are decoded, so a gigapixel slide
+     *  streams through the pipeline instead of being read whole. The image
+     *  is read as 8 bit RGB; JPEG compressed YCbCr tiles are converted by
+     *  libtiff. Spacing follows the TIFF resolution as ITK's TIFFImageIO
+     *  does. Not for writing. */
+    class RFtiffImageIO : public ImageIOBase
+    {
+        public:
+          /** Standard class typedefs. */
+          typedef RFtiffImageIO Self;
+          typedef ImageIOBase Superclass;
+          typedef SmartPointer< Self > Pointer;
+
+          /** Method for creation through the object factory. */
+          itkNewMacro(Self);
+
+          /** Run-time type information (and related methods). */
+          itkTypeMacro(RFtiffImageIO, ImageIOBase);
+
+          /** True for a tiled TIFF, the other images are left to the IOs
+           *  of the factory **/
+          static bool IsTiledTIFF(const std::string fileName)
+          {
+              TIFFErrorHandler warningHandler = TIFFSetWarningHandler(NULL);
+              TIFFErrorHandler errorHandler = TIFFSetErrorHandler(NULL);
+              TIFF *tiff = TIFFOpen(fileName.c_str(), "r");
+              TIFFSetWarningHandler(warningHandler);
+              TIFFSetErrorHandler(errorHandler);
+              if (tiff == NULL)
+              {
+                  return false;
+              }
+              bool tiled = TIFFIsTiled(tiff);
+              TIFFClose(tiff);
+              return tiled;
+          }
+
+          virtual bool CanReadFile(const char *fileName)
+          {
+              return IsTiledTIFF(fileName);
+          }
+
+          /** Regions are read as requested **/
+          virtual bool CanStreamRead()
+          {
+              return true;
+          }
+
+          virtual void ReadImageInformation()
+          {
+              this->Open();
+
+              uint32_t width = 0;
+              uint32_t height = 0;
+              uint16_t samplesPerPixel = 0;
+              uint16_t bitsPerSample = 0;
+              uint16_t planarConfig = 0;
+              uint16_t photometric = 0;
+              uint16_t compression = 0;
+              TIFFGetField(m_Tiff, TIFFTAG_IMAGEWIDTH, &width);
+              TIFFGetField(m_Tiff, TIFFTAG_IMAGELENGTH, &height);
+              TIFFGetField(m_Tiff, TIFFTAG_TILEWIDTH, &m_TileWidth);
+              TIFFGetField(m_Tiff, TIFFTAG_TILELENGTH, &m_TileHeight);
+              TIFFGetFieldDefaulted(m_Tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+              TIFFGetFieldDefaulted(m_Tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+              TIFFGetFieldDefaulted(m_Tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+              TIFFGetFieldDefaulted(m_Tiff, TIFFTAG_COMPRESSION, &compression);
+              TIFFGetField(m_Tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+              if ((bitsPerSample != 8) || (samplesPerPixel < 3) || (planarConfig != PLANARCONFIG_CONTIG))
+              {
+                  itkExceptionMacro(<< m_FileName << " is not an interleaved 8 bit color TIFF");
+              }
+              if ((photometric != PHOTOMETRIC_RGB)
+                  && ((photometric != PHOTOMETRIC_YCBCR) || (compression != COMPRESSION_JPEG)))
+              {
+                  itkExceptionMacro(<< m_FileName << " is neither RGB nor JPEG compressed YCbCr");
+              }
+              m_SamplesPerPixel = samplesPerPixel;
+
+              this->SetNumberOfDimensions(2);
+              this->SetDimensions(0, width);
+              this->SetDimensions(1, height);
+              this->SetOrigin(0, 0.0);
+              this->SetOrigin(1, 0.0);
+              this->SetSpacing(0, 1.0);
+              this->SetSpacing(1, 1.0);
+
+              uint16_t resolutionUnit = 0;
+              float xResolution = 0;
+              float yResolution = 0;
+              if (TIFFGetField(m_Tiff, TIFFTAG_RESOLUTIONUNIT, &resolutionUnit)
+                  && TIFFGetField(m_Tiff, TIFFTAG_XRESOLUTION, &xResolution)
+                  && TIFFGetField(m_Tiff, TIFFTAG_YRESOLUTION, &yResolution)
+                  && (xResolution > 0) && (yResolution > 0))
+              {
+                  if (resolutionUnit == RESUNIT_INCH)
+                  {
+                      this->SetSpacing(0, 25.4 / xResolution);
+                      this->SetSpacing(1, 25.4 / yResolution);
+                  }
+                  else if (resolutionUnit == RESUNIT_CENTIMETER)
+                  {
+                      this->SetSpacing(0, 10.0 / xResolution);
+                      this->SetSpacing(1, 10.0 / yResolution);
+                  }
+              }
+
+              this->SetPixelType(RGB);
+              this->SetComponentType(UCHAR);
+              this->SetNumberOfComponents(3);
+          }
+
+          /** Decodes the tiles overlapping the IO region into buffer **/
+          virtual void Read(void *buffer)
+          {
+              this->Open();
+              const ImageIORegion region = this->GetIORegion();
+              const uint32_t x0 = region.GetIndex(0);
+              const uint32_t y0 = region.GetIndex(1);
+              const uint32_t x1 = x0 + region.GetSize(0);
+              const uint32_t y1 = y0 + region.GetSize(1);
+              unsigned char *output = static_cast<unsigned char *>(buffer);
+
+              std::vector<unsigned char> tile(TIFFTileSize(m_Tiff));
+              for (uint32_t ty = y0 - y0 % m_TileHeight; ty < y1; ty += m_TileHeight)
+              {
+                  for (uint32_t tx = x0 - x0 % m_TileWidth; tx < x1; tx += m_TileWidth)
+                  {
+                      if (TIFFReadTile(m_Tiff, &tile[0], tx, ty, 0, 0) < 0)
+                      {
+                          itkExceptionMacro(<< "Cannot read the tile at " << tx << ", " << ty
+                                            << " of " << m_FileName);
+                      }
+                      // Copy the part of the tile in the region, without alpha
+                      const uint32_t xa = std::max(tx, x0);
+                      const uint32_t xb = std::min(tx + m_TileWidth, x1);
+                      for (uint32_t y = std::max(ty, y0); y < std::min(ty + m_TileHeight, y1); y++)
+                      {
+                          const unsigned char *from = &tile[0] + ((y - ty) * m_TileWidth + (xa - tx)) * m_SamplesPerPixel;
+                          unsigned char *to = output + ((size_t)(y - y0) * (x1 - x0) + (xa - x0)) * 3;
+                          for (uint32_t x = xa; x < xb; x++, from += m_SamplesPerPixel, to += 3)
+                          {
+                              to[0] = from[0];
+                              to[1] = from[1];
+                              to[2] = from[2];
+                          }
+                      }
+                  }
+              }
+          }
+
+          /** The width and height of the native tiles **/
+          unsigned int GetTileWidth() const { return m_TileWidth; }
+          unsigned int GetTileHeight() const { return m_TileHeight; }
+
+          virtual bool CanWriteFile(const char *)
+          {
+              return false;
+          }
+
+          virtual void WriteImageInformation() {}
+
+          virtual void Write(const void *)
+          {
+              itkExceptionMacro(<< "Tiled TIFFs are not written");
+          }
+
+        protected:
+          RFtiffImageIO(): m_Tiff(NULL), m_TileWidth(0), m_TileHeight(0), m_SamplesPerPixel(0)
+          {
+              this->AddSupportedReadExtension(".tif");
+              this->AddSupportedReadExtension(".tiff");
+              this->AddSupportedReadExtension(".svs");
+          }
+          ~RFtiffImageIO()
+          {
+              if (m_Tiff != NULL)
+              {
+                  TIFFClose(m_Tiff);
+              }
+          }
+
+        private:
+          RFtiffImageIO(const Self &); //purposely not implemented
+          void operator=(const Self &);  //purposely not implemented
+
+          /** Opens the file once, or again for another file name **/
+          void Open()
+          {
+              if ((m_Tiff != NULL) && (m_OpenFileName == m_FileName))
+              {
+                  return;
+              }
+              if (m_Tiff != NULL)
+              {
+                  TIFFClose(m_Tiff);
+              }
+              m_Tiff = TIFFOpen(m_FileName.c_str(), "r");
+              if (m_Tiff == NULL)
+              {
+                  itkExceptionMacro(<< "Cannot open " << m_FileName);
+              }
+              if (!TIFFIsTiled(m_Tiff))
+              {
+                  itkExceptionMacro(<< m_FileName << " is not a tiled TIFF");
+              }
+
+              // libtiff converts JPEG compressed YCbCr tiles to RGB
+              uint16_t photometric = 0;
+              uint16_t compression = 0;
+              TIFFGetField(m_Tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+              TIFFGetFieldDefaulted(m_Tiff, TIFFTAG_COMPRESSION, &compression);
+              if ((photometric == PHOTOMETRIC_YCBCR) && (compression == COMPRESSION_JPEG))
+              {
+                  TIFFSetField(m_Tiff, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+              }
+              m_OpenFileName = m_FileName;
+          }
+
+          TIFF *m_Tiff;
+          std::string m_OpenFileName;
+          uint32_t m_TileWidth;
+          uint32_t m_TileHeight;
+          uint16_t m_SamplesPerPixel;
+    };
+
+} //namespace ITK
+
+#endif // __RFtiff_h
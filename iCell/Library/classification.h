@@ -8,6 +8,9 @@
 #include <set>
 #include <map>
 #include "trainer.h"
+#include "compiledforest.h"
+#include "quickscorer.h"
+#include "featureview.h"
 
 // Bug - Paul (changed labelT to be a parameter)
 template<class dataT, class labelT, class ClassifierT>
@@ -18,12 +21,13 @@ public:
   typedef Histogram<dataT, labelT> HistStatisticsT;
   typedef ClassificationContext<ClassifierT, dataT, labelT> ClassificationContextT;
   typedef DecisionForest<HistStatisticsT, ClassifierT, dataT> DecisionForestT;
+  typedef CompiledForest<dataT> CompiledForestT;
+  typedef QuickScorer<dataT> QuickScorerT;
   typedef Trainer<ClassifierT, HistStatisticsT, dataT, labelT> TrainerT;
 
   // Bug - Paul (changed int to labelT)
   typedef MLData<dataT, labelT> TrainingDataT;
   typedef MLData<dataT, HistStatisticsT*> TestingDataT;
-  typedef Vector<Vector<HistStatisticsT*> > TestingResultT;
   typedef Matrix<double> SoftPredictionT;
   typedef Vector<int> HardPredictionT;
 
@@ -82,65 +86,568 @@ public:
           }
       }
 
-    Random random;
     ClassificationContextT classificationTC(trainingData.Dimension(), classNum);
-    TrainerT trainer(trainingData, trainingParameters, classificationTC, random);
+    TrainerT trainer(trainingData, trainingParameters, classificationTC);
 
     trainer.Training(forest);
   }
 
+  // same learning, but only the trees of forest at indices treeIdx are
+  // trained (again), see Trainer::Training. The training data must have the
+  // classes the forest was first trained on
+  void Updating(TrainingParameters& trainingParameters,
+                TrainingDataT& trainingData,
+                DecisionForestT& forest,
+                const std::vector<index_t>& treeIdx,
+                bool& validLabel,
+                std::map<index_t, labelT>& mapping)
+  {
+    validLabel = ValidData(trainingData, mapping);
+    size_t classNum = mapping.size();
+    if ( !trainingParameters.weights.empty() )
+      {
+        if (classNum != trainingParameters.weights.size())
+          {
+            throw std::runtime_error("Traing parameter weights size doesn't match class size in data\n");
+          }
+      }
+
+    ClassificationContextT classificationTC(trainingData.Dimension(), classNum);
+    TrainerT trainer(trainingData, trainingParameters, classificationTC);
+
+    trainer.Training(forest, treeIdx);
+  }
+
   void Predicting(DecisionForestT& forest,
                   TestingDataT& testingData,
                   bool& validLabel, std::map<index_t, labelT>& mapping,
                   SoftPredictionT& softPrediction,
                   HardPredictionT&  hardPrediction)
   {
-    TestingResultT testingResult;
-    forest.Apply(testingData, testingResult);
-
     size_t classNum = mapping.size();
-    size_t treeNum = testingResult.Size();
-    size_t dataNum = testingResult[0].Size();
-    std::vector<double> max(dataNum, 0);
+    size_t treeNum = forest.trees_.size();
+    size_t dataNum = testingData.Size();
 
+    // votes are summed per sample as each tree is travelled, so no
+    // per-tree leaf pointers are kept for the whole testing data
     #pragma omp parallel for
     for (index_t i = 0; i < dataNum; ++i)
       {
+        std::vector<double>& prediction = softPrediction[i];
         for (index_t j = 0; j < classNum; ++j)
           {
-            for (index_t k = 0; k < treeNum; ++k)
+            prediction[j] = 0;
+          }
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            const std::vector<double>& prob = forest.trees_[k]->Leaf(testingData, i)->prob_;
+            for (index_t j = 0; j < classNum; ++j)
+              {
+                prediction[j] += prob[j];
+              }
+          }
+        Decide(&prediction[0], classNum, treeNum, validLabel, mapping, hardPrediction[i]);
+      }
+  }
+
+  // same prediction as above, but travels the flattened forest. Samples are
+  // packed into blocks so that each tree is evaluated on a whole block at a
+  // time by the widest traversal kernel the processor supports. The leaf
+  // votes are summed as given by vote, see VoteMode
+  void Predicting(const CompiledForestT& forest,
+                  TestingDataT& testingData,
+                  bool& validLabel, std::map<index_t, labelT>& mapping,
+                  SoftPredictionT& softPrediction,
+                  HardPredictionT&  hardPrediction,
+                  VoteMode vote = ExactVote)
+  {
+    DataRows features(testingData);
+    PredictionRows predictions(softPrediction, hardPrediction);
+    PredictingBlocks(forest, features, validLabel, mapping, predictions, vote);
+  }
+
+  // same prediction, finding the exit leaves with the QuickScorer evaluator
+  void Predicting(const QuickScorerT& scorer,
+                  TestingDataT& testingData,
+                  bool& validLabel, std::map<index_t, labelT>& mapping,
+                  SoftPredictionT& softPrediction,
+                  HardPredictionT&  hardPrediction,
+                  VoteMode vote = ExactVote)
+  {
+    DataRows features(testingData);
+    PredictionRows predictions(softPrediction, hardPrediction);
+    PredictingBlocks(scorer, features, validLabel, mapping, predictions, vote);
+  }
+
+  // same prediction through the compiled forest, but a sample leaves the
+  // block once its hard label is settled: when the gap between its two best
+  // class sums exceeds the swing the remaining trees can still make, or, if
+  // margin > 0, when that gap averaged over the trees travelled so far
+  // reaches margin. The exact bound gives the same hard labels as
+  // travelling all trees; the soft prediction of an early sample is the
+  // average over the trees it travelled. Returns the number of samples that
+  // stopped before the last tree
+  size_t PredictingEarlyExit(const CompiledForestT& forest,
+                             TestingDataT& testingData,
+                             bool& validLabel, std::map<index_t, labelT>& mapping,
+                             SoftPredictionT& softPrediction,
+                             HardPredictionT&  hardPrediction,
+                             double margin = 0)
+  {
+    DataRows features(testingData);
+    PredictionRows predictions(softPrediction, hardPrediction);
+    return PredictingEarlyExit(forest, features, validLabel, mapping, predictions, margin);
+  }
+
+  // FeaturesT gives the samples (Size, Dimension, and Gather to copy a range
+  // of them into a block, see FeatureView) and PredictionsT receives the
+  // prediction of every sample (Store, see PredictionView), so the features
+  // can be read from and the results written to image buffers directly
+  template<class FeaturesT, class PredictionsT>
+  size_t PredictingEarlyExit(const CompiledForestT& forest,
+                             const FeaturesT& features,
+                             bool& validLabel, std::map<index_t, labelT>& mapping,
+                             PredictionsT& predictions,
+                             double margin = 0)
+  {
+    typedef typename CompiledForestT::offset_t offset_t;
+    static const size_t blockSize = 256;
+    size_t classNum = mapping.size();
+    size_t treeNum = forest.TreeNum();
+    size_t dataNum = features.Size();
+    size_t dataDim = features.Dimension();
+    size_t blockNum = (dataNum + blockSize - 1) / blockSize;
+    if (classNum > forest.ClassNum())
+      {
+        throw std::runtime_error("Classificaiton: Predicting class number exceeds forest");
+      }
+    // covers the rounding of the class sums
+    double slack = treeNum * treeNum * std::numeric_limits<double>::epsilon();
+    size_t exitNum = 0;
+
+    #pragma omp parallel for reduction(+:exitNum)
+    for (index_t b = 0; b < blockNum; ++b)
+      {
+        index_t begin = b * blockSize;
+        size_t n = std::min(blockSize, dataNum - begin);
+        std::vector<dataT> block(n * dataDim);
+        std::vector<offset_t> leaves(n);
+        std::vector<index_t> sample(n);
+        std::vector<double> sums(n * classNum, 0.0);
+        features.Gather(begin, n, &block[0]);
+        for (index_t i = 0; i < n; ++i)
+          {
+            sample[i] = i;
+          }
+        // the rows of the samples still travelling are kept packed at the
+        // front of the block, a sample leaving is replaced by the last one
+        size_t active = n;
+        for (index_t k = 0; (k < treeNum) && (active > 0); ++k)
+          {
+            forest.Leaves(k, &block[0], dataDim, active, &leaves[0]);
+            index_t a = 0;
+            while (a < active)
               {
-                if (k == 0)
+                const double* prob = forest.LeafProbability(leaves[a]);
+                double* sum = &sums[sample[a] * classNum];
+                double first = 0;
+                double second = 0;
+                for (index_t j = 0; j < classNum; ++j)
+                  {
+                    sum[j] += prob[j];
+                    second = std::max(second, std::min(first, sum[j]));
+                    first = std::max(first, sum[j]);
+                  }
+                double gap = first - second;
+                if ((k + 1 < treeNum) &&
+                    ((gap > forest.remainingSwing_[k + 1] + slack) ||
+                     ((margin > 0) && (gap >= margin * (k + 1)))))
                   {
-                    softPrediction[i][j] = testingResult[k][i]->prob_[j];
+                    int hardPrediction = 0;
+                    Decide(sum, classNum, k + 1, validLabel, mapping, hardPrediction);
+                    predictions.Store(begin + sample[a], sum, classNum, hardPrediction);
+                    ++exitNum;
+                    --active;
+                    std::copy(block.begin() + active * dataDim, block.begin() + (active + 1) * dataDim,
+                              block.begin() + a * dataDim);
+                    sample[a] = sample[active];
+                    leaves[a] = leaves[active];
                   }
                 else
                   {
-                    softPrediction[i][j] = softPrediction[i][j] + testingResult[k][i]->prob_[j];
+                    ++a;
                   }
               }
-            softPrediction[i][j] = softPrediction[i][j] / treeNum;
-            if (softPrediction[i][j] > max[i])
+          }
+        for (index_t a = 0; a < active; ++a)
+          {
+            double* sum = &sums[sample[a] * classNum];
+            int hardPrediction = 0;
+            Decide(sum, classNum, treeNum, validLabel, mapping, hardPrediction);
+            predictions.Store(begin + sample[a], sum, classNum, hardPrediction);
+          }
+      }
+    return exitNum;
+  }
+
+  // EvaluatorT gives the leaves of a block of samples in every tree of its
+  // compiled forest, see CompiledForest::Leaves. FeaturesT and PredictionsT
+  // are as for PredictingEarlyExit; PredictionsT also receives the leaves and
+  // the vote sums of every block (StoreLeaves and StoreVoteSums, see
+  // PredictionView)
+  template<class EvaluatorT, class FeaturesT, class PredictionsT>
+  void PredictingBlocks(const EvaluatorT& evaluator,
+                        const FeaturesT& features,
+                        bool& validLabel, std::map<index_t, labelT>& mapping,
+                        PredictionsT& predictions,
+                        VoteMode vote = ExactVote)
+  {
+    typedef typename CompiledForestT::offset_t offset_t;
+    static const size_t blockSize = 256;
+    const CompiledForestT& forest = evaluator.Forest();
+    size_t classNum = mapping.size();
+    size_t treeNum = forest.TreeNum();
+    size_t dataNum = features.Size();
+    size_t dataDim = features.Dimension();
+    size_t blockNum = (dataNum + blockSize - 1) / blockSize;
+    if (classNum > forest.ClassNum())
+      {
+        throw std::runtime_error("Classificaiton: Predicting class number exceeds forest");
+      }
+    if (!VoteSumFits(vote, treeNum))
+      {
+        throw std::runtime_error("Classification: fixed16 votes of more than 65537 trees overflow");
+      }
+
+    #pragma omp parallel for
+    for (index_t b = 0; b < blockNum; ++b)
+      {
+        index_t begin = b * blockSize;
+        size_t n = std::min(blockSize, dataNum - begin);
+        std::vector<dataT> block(n * dataDim);
+        std::vector<offset_t> leaves(n * treeNum);
+        features.Gather(begin, n, &block[0]);
+        evaluator.Leaves(&block[0], dataDim, n, &leaves[0]);
+        predictions.StoreLeaves(begin, n, &leaves[0], &forest.leafBegin_[0], treeNum);
+        VoteBlock(forest, &leaves[0], begin, n, vote, validLabel, mapping, predictions);
+      }
+  }
+
+  // same prediction from leaves found before, so that a forest whose leaf
+  // statistics changed but whose trees did not can predict again without
+  // features. LeavesT gives the samples' leaves (Size, and Gather to copy
+  // those of a range of samples, tree by tree, false if they cannot be
+  // leaves of forest; see LeafIndexView)
+  template<class LeavesT, class PredictionsT>
+  void PredictingCachedLeaves(const CompiledForestT& forest,
+                              const LeavesT& cachedLeaves,
+                              bool& validLabel, std::map<index_t, labelT>& mapping,
+                              PredictionsT& predictions,
+                              VoteMode vote = ExactVote)
+  {
+    typedef typename CompiledForestT::offset_t offset_t;
+    static const size_t blockSize = 256;
+    size_t classNum = mapping.size();
+    size_t treeNum = forest.TreeNum();
+    size_t dataNum = cachedLeaves.Size();
+    size_t blockNum = (dataNum + blockSize - 1) / blockSize;
+    if (classNum > forest.ClassNum())
+      {
+        throw std::runtime_error("Classificaiton: Predicting class number exceeds forest");
+      }
+    if (!VoteSumFits(vote, treeNum))
+      {
+        throw std::runtime_error("Classification: fixed16 votes of more than 65537 trees overflow");
+      }
+
+    size_t invalidNum = 0;
+    #pragma omp parallel for reduction(+:invalidNum)
+    for (index_t b = 0; b < blockNum; ++b)
+      {
+        index_t begin = b * blockSize;
+        size_t n = std::min(blockSize, dataNum - begin);
+        std::vector<offset_t> leaves(n * treeNum);
+        if (!cachedLeaves.Gather(begin, n, &leaves[0]))
+          {
+            ++invalidNum;
+            continue;
+          }
+        VoteBlock(forest, &leaves[0], begin, n, vote, validLabel, mapping, predictions);
+      }
+    if (invalidNum > 0)
+      {
+        throw std::runtime_error("Classificaiton: cached leaves do not belong to the forest");
+      }
+  }
+
+  // trees of oldForest that are not in newForest at the same place, and
+  // trees of newForest that are not in oldForest at the same place: changed
+  // trees are in both lists, trees beyond the end of the other forest in
+  // one of them. A tree is the same when its splits and leaf
+  // probabilities are (CompiledForest::TreeFingerprint)
+  static void ChangedTrees(const CompiledForestT& oldForest, const CompiledForestT& newForest,
+                           std::vector<index_t>& removedTrees, std::vector<index_t>& addedTrees)
+  {
+    removedTrees.clear();
+    addedTrees.clear();
+    for (index_t k = 0; k < std::max(oldForest.TreeNum(), newForest.TreeNum()); ++k)
+      {
+        bool inOld = (k < oldForest.TreeNum());
+        bool inNew = (k < newForest.TreeNum());
+        if (inOld && inNew && (oldForest.TreeFingerprint(k) == newForest.TreeFingerprint(k)))
+          {
+            continue;
+          }
+        if (inOld)
+          {
+            removedTrees.push_back(k);
+          }
+        if (inNew)
+          {
+            addedTrees.push_back(k);
+          }
+      }
+  }
+
+  // prediction of newForest from the vote sums of oldForest kept by an
+  // earlier run (StoreVoteSums, see PredictionView), travelling only the
+  // trees that changed (see ChangedTrees): the votes of the removed trees of
+  // oldForest are taken off the sums and those of the added trees of
+  // newForest put on. VoteSumsT gives the kept sums (Gather, see
+  // VoteSumView), which must have been summed as given by vote. FeaturesT and
+  // PredictionsT are as for PredictingBlocks, the features are only read
+  // when a tree changed
+  template<class FeaturesT, class VoteSumsT, class PredictionsT>
+  void PredictingUpdate(const CompiledForestT& oldForest, const std::vector<index_t>& removedTrees,
+                        const CompiledForestT& newForest, const std::vector<index_t>& addedTrees,
+                        const FeaturesT& features, const VoteSumsT& cachedSums,
+                        bool& validLabel, std::map<index_t, labelT>& mapping,
+                        PredictionsT& predictions,
+                        VoteMode vote = ExactVote)
+  {
+    typedef typename CompiledForestT::offset_t offset_t;
+    static const size_t blockSize = 256;
+    size_t classNum = mapping.size();
+    size_t treeNum = newForest.TreeNum();
+    size_t dataNum = cachedSums.Size();
+    size_t dataDim = features.Dimension();
+    size_t blockNum = (dataNum + blockSize - 1) / blockSize;
+    size_t changedNum = std::max(removedTrees.size(), addedTrees.size());
+    if ((classNum > oldForest.ClassNum()) || (classNum > newForest.ClassNum()))
+      {
+        throw std::runtime_error("Classificaiton: Predicting class number exceeds forest");
+      }
+    if (!VoteSumFits(vote, std::max(oldForest.TreeNum(), treeNum)))
+      {
+        throw std::runtime_error("Classification: fixed16 votes of more than 65537 trees overflow");
+      }
+
+    #pragma omp parallel for
+    for (index_t b = 0; b < blockNum; ++b)
+      {
+        index_t begin = b * blockSize;
+        size_t n = std::min(blockSize, dataNum - begin);
+        std::vector<double> sums(n * classNum);
+        cachedSums.Gather(begin, n, classNum, &sums[0]);
+        if (changedNum > 0)
+          {
+            std::vector<dataT> block(n * dataDim);
+            std::vector<offset_t> leaves(n * changedNum);
+            std::vector<double> votes(n * classNum);
+            features.Gather(begin, n, &block[0]);
+
+            for (index_t r = 0; r < removedTrees.size(); ++r)
+              {
+                oldForest.Leaves(removedTrees[r], &block[0], dataDim, n, &leaves[r * n]);
+              }
+            SumBlock(oldForest, &leaves[0], removedTrees.size(), n, classNum, vote, &votes[0]);
+            for (index_t j = 0; j < n * classNum; ++j)
+              {
+                sums[j] -= votes[j];
+              }
+
+            for (index_t a = 0; a < addedTrees.size(); ++a)
+              {
+                newForest.Leaves(addedTrees[a], &block[0], dataDim, n, &leaves[a * n]);
+              }
+            SumBlock(newForest, &leaves[0], addedTrees.size(), n, classNum, vote, &votes[0]);
+            for (index_t j = 0; j < n * classNum; ++j)
               {
-                max[i] = softPrediction[i][j];
-                hardPrediction[i] = j;
+                // rounding in the kept sums never makes a vote negative
+                sums[j] = std::max(0.0, sums[j] + votes[j]);
               }
           }
-        if (validLabel == false)
+        predictions.StoreVoteSums(begin, n, classNum, &sums[0]);
+        for (index_t i = 0; i < n; ++i)
           {
-            // Bug: typename missing
-            typename std::map<index_t, labelT>::iterator mapIter = mapping.find(hardPrediction[i]);
-            if (mapIter == mapping.end())
+            int hardPrediction = 0;
+            Decide(&sums[i * classNum], classNum, treeNum, validLabel, mapping, hardPrediction);
+            predictions.Store(begin + i, &sums[i * classNum], classNum, hardPrediction);
+          }
+      }
+  }
+
+  // sum the votes of the leaves of the n samples from begin (leaves[k * n + i]
+  // being the leaf of sample i in tree k) as given by vote, and store their
+  // predictions
+  template<class PredictionsT>
+  void VoteBlock(const CompiledForestT& forest,
+                 const typename CompiledForestT::offset_t* leaves,
+                 index_t begin, size_t n, VoteMode vote,
+                 bool& validLabel, std::map<index_t, labelT>& mapping,
+                 PredictionsT& predictions)
+  {
+    size_t classNum = mapping.size();
+    size_t treeNum = forest.TreeNum();
+    std::vector<double> sums(n * classNum, 0.0);
+    SumBlock(forest, leaves, treeNum, n, classNum, vote, &sums[0]);
+    predictions.StoreVoteSums(begin, n, classNum, &sums[0]);
+    for (index_t i = 0; i < n; ++i)
+      {
+        int hardPrediction = 0;
+        Decide(&sums[i * classNum], classNum, treeNum, validLabel, mapping, hardPrediction);
+        predictions.Store(begin + i, &sums[i * classNum], classNum, hardPrediction);
+      }
+  }
+
+  // sums, classNum per sample, of the votes of the leaves of n samples in
+  // treeNum trees of forest (leaves[k * n + i] being the leaf of sample i in
+  // the k-th of them) as given by vote
+  void SumBlock(const CompiledForestT& forest,
+                const typename CompiledForestT::offset_t* leaves,
+                size_t treeNum, size_t n, size_t classNum, VoteMode vote,
+                double* sums)
+  {
+    // 8 bit and hard votes fit 16 bit counters up to 257 and 65535 trees
+    bool narrow = (vote == Fixed8Vote) ? (treeNum <= 257) : (treeNum <= 65535);
+    std::fill(sums, sums + n * classNum, 0.0);
+    switch (vote)
+      {
+      case Fixed16Vote:
+        SumVotes<unsigned int>(&forest.leafVote16_[0], forest.ClassNum(), 65535,
+                               leaves, treeNum, n, classNum, sums);
+        break;
+      case Fixed8Vote:
+        if (narrow)
+          {
+            SumVotes<unsigned short>(&forest.leafVote8_[0], forest.ClassNum(), 255,
+                                     leaves, treeNum, n, classNum, sums);
+          }
+        else
+          {
+            SumVotes<unsigned int>(&forest.leafVote8_[0], forest.ClassNum(), 255,
+                                   leaves, treeNum, n, classNum, sums);
+          }
+        break;
+      case HardVote:
+        if (narrow)
+          {
+            SumHardVotes<unsigned short>(forest, leaves, treeNum, n, classNum, sums);
+          }
+        else
+          {
+            SumHardVotes<unsigned int>(forest, leaves, treeNum, n, classNum, sums);
+          }
+        break;
+      default:
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            for (index_t i = 0; i < n; ++i)
               {
-                throw std::runtime_error("Classificaiton: Predicting mapping error");
+                const double* prob = forest.LeafProbability(leaves[k * n + i]);
+                double* sum = &sums[i * classNum];
+                for (index_t j = 0; j < classNum; ++j)
+                  {
+                    sum[j] += prob[j];
+                  }
               }
-            else
+          }
+      }
+  }
+
+  // sum the fixed point leaf votes table (width entries per leaf, scale for a
+  // probability of 1) of n samples in treeNum trees in integer counters, and
+  // store the sums as probabilities summed over trees, classNum per sample
+  template<class CountT, class VoteT>
+  void SumVotes(const VoteT* table, size_t width, double scale,
+                const typename CompiledForestT::offset_t* leaves,
+                size_t treeNum, size_t n, size_t classNum, double* sums)
+  {
+    std::vector<CountT> counts(n * width, 0);
+    for (index_t k = 0; k < treeNum; ++k)
+      {
+        for (index_t i = 0; i < n; ++i)
+          {
+            const VoteT* votes = table + leaves[k * n + i] * width;
+            CountT* count = &counts[i * width];
+            for (index_t j = 0; j < width; ++j)
               {
-                hardPrediction[i] = mapIter->second;
+                count[j] += votes[j];
               }
           }
       }
+    for (index_t i = 0; i < n; ++i)
+      {
+        for (index_t j = 0; j < classNum; ++j)
+          {
+            sums[i * classNum + j] = counts[i * width + j] / scale;
+          }
+      }
+  }
+
+  // count, for n samples, the treeNum trees whose leaf has each class as its
+  // most probable one
+  template<class CountT>
+  void SumHardVotes(const CompiledForestT& forest,
+                    const typename CompiledForestT::offset_t* leaves,
+                    size_t treeNum, size_t n, size_t classNum, double* sums)
+  {
+    // one more counter per sample for the empty leaves
+    size_t width = forest.ClassNum() + 1;
+    std::vector<CountT> counts(n * width, 0);
+    for (index_t k = 0; k < treeNum; ++k)
+      {
+        for (index_t i = 0; i < n; ++i)
+          {
+            ++counts[i * width + forest.leafClass_[leaves[k * n + i]]];
+          }
+      }
+    for (index_t i = 0; i < n; ++i)
+      {
+        for (index_t j = 0; j < classNum; ++j)
+          {
+            sums[i * classNum + j] = counts[i * width + j];
+          }
+      }
+  }
 
+  // turn the summed tree votes of one sample into its soft and hard prediction
+  void Decide(double* prediction, size_t classNum, size_t treeNum,
+              bool validLabel, std::map<index_t, labelT>& mapping,
+              int& hardPrediction)
+  {
+    double max = 0;
+    for (index_t j = 0; j < classNum; ++j)
+      {
+        prediction[j] = prediction[j] / treeNum;
+        if (prediction[j] > max)
+          {
+            max = prediction[j];
+            hardPrediction = j;
+          }
+      }
+    if (validLabel == false)
+      {
+        typename std::map<index_t, labelT>::iterator mapIter = mapping.find(hardPrediction);
+        if (mapIter == mapping.end())
+          {
+            throw std::runtime_error("Classificaiton: Predicting mapping error");
+          }
+        else
+          {
+            hardPrediction = mapIter->second;
+          }
+      }
   }
 
   void Run(TrainingParameters& trainingParameters,
@@ -162,6 +669,50 @@ public:
     Predicting(forest, testingData, validLabel, mapping, softPrediction, hardPrediction);
     std::cerr << "testing finished, spending " << timer.StopAndSpendSecond() << " secs\n";
   }
+
+  // the samples of an MLData, as FeaturesT of PredictingBlocks
+  class DataRows
+  {
+  public:
+    DataRows(TestingDataT& testingData): testingData_(testingData) {}
+
+    size_t Size() const { return testingData_.Size(); }
+    size_t Dimension() const { return testingData_.Dimension(); }
+
+    void Gather(index_t begin, size_t n, dataT* block) const
+    {
+      size_t dataDim = testingData_.Dimension();
+      for (index_t i = 0; i < n; ++i)
+        {
+          const std::vector<dataT>& x = testingData_.data[begin + i];
+          std::copy(x.begin(), x.begin() + dataDim, block + i * dataDim);
+        }
+    }
+
+    TestingDataT& testingData_;
+  };
+
+  // soft and hard prediction matrices, as PredictionsT of PredictingBlocks
+  class PredictionRows
+  {
+  public:
+    PredictionRows(SoftPredictionT& softPrediction, HardPredictionT& hardPrediction)
+      : softPrediction_(softPrediction), hardPrediction_(hardPrediction) {}
+
+    void Store(index_t i, const double* prediction, size_t classNum, int label)
+    {
+      std::copy(prediction, prediction + classNum, softPrediction_[i].begin());
+      hardPrediction_[i] = label;
+    }
+
+    // the rows keep the predictions only
+    void StoreLeaves(index_t, size_t, const unsigned int*, const unsigned int*, size_t) {}
+
+    void StoreVoteSums(index_t, size_t, size_t, const double*) {}
+
+    SoftPredictionT& softPrediction_;
+    HardPredictionT& hardPrediction_;
+  };
 };
 
 #endif // CLASSIFICATION_H
@@ -6,6 +6,7 @@
 #define CLASSIFIER_H
 
 #include <math.h>
+#include "columnstore.h"
 #include "data.h"
 #include "random.h"
 
@@ -53,6 +54,17 @@ public:
     return ((const MLDataT&)data).data[index][axis_];
   }
 
+  // feature responses of the n samples, a gather from the column of axis
+  void FeatureResponses(const ColumnStore<dataT>& store, const sample_t* samples,
+                        size_t n, double* responses) const
+  {
+    const dataT* column = store.Column(axis_);
+    for (size_t k = 0; k < n; ++k)
+      {
+        responses[k] = column[samples[k]];
+      }
+  }
+
   void Print(int level)
   {
     std::cout << "- Classifier: axis"
@@ -84,6 +96,20 @@ public:
   int axis_;
 };
 
+// value is true for the axis aligned classifiers, the only ones the
+// trainer trains on binned features
+template<class C>
+struct IsAxisAligned
+{
+  static const bool value = false;
+};
+
+template<class dataT, class labelT>
+struct IsAxisAligned<AxisAlignedClassifier<dataT, labelT> >
+{
+  static const bool value = true;
+};
+
 template<class dataT, class labelT>
 class LinearClassifier
     : public Classifier<LinearClassifier<dataT, labelT>, dataT, labelT>
@@ -101,20 +127,23 @@ public:
   LinearClassifier(int dimension, std::vector<dataT>& unitVector)
     : featureDim_(dimension), unitVector_(unitVector) {}
 
+  // the direction is drawn into a vector of its own: the classifier of the
+  // training context is shared by the concurrent node tasks
   LinearClassifierT RandomClassifier(Random &random)
   {
+    std::vector<dataT> unitVector(featureDim_);
     double length = 0;
     for (int i = 0; i < featureDim_; ++i)
       {
-        unitVector_[i] = 2.0 * random.RandD() - 1.0;
-        length += unitVector_[i] * unitVector_[i];
+        unitVector[i] = 2.0 * random.RandD() - 1.0;
+        length += unitVector[i] * unitVector[i];
       }
     length = sqrt(length);
     for (int i = 0; i < featureDim_; ++i)
       {
-        unitVector_[i] = unitVector_[i] / length;
+        unitVector[i] = unitVector[i] / length;
       }
-    return LinearClassifierT(featureDim_, unitVector_);
+    return LinearClassifierT(featureDim_, unitVector);
   }
 
   double FeatureResponse(const DataSet &data, index_t index) const
@@ -127,6 +156,26 @@ public:
     return dotProduct;
   }
 
+  // feature responses of the n samples, summed a column at a time in the
+  // order of FeatureResponse
+  void FeatureResponses(const ColumnStore<dataT>& store, const sample_t* samples,
+                        size_t n, double* responses) const
+  {
+    for (size_t k = 0; k < n; ++k)
+      {
+        responses[k] = 0;
+      }
+    for (int i = 0; i < featureDim_; ++i)
+      {
+        const dataT* column = store.Column(i);
+        const dataT u = unitVector_[i];
+        for (size_t k = 0; k < n; ++k)
+          {
+            responses[k] += column[samples[k]] * u;
+          }
+      }
+  }
+
   void Print(int level)
   {
     std::cout << "- Classifier: linear"
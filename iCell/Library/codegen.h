@@ -0,0 +1,153 @@
+/**
+ * Define a generator of C++ source specialized to one compiled forest.
+ *
+ * Every tree becomes a function of the sample's features in which split
+ * axes, thresholds and leaf ids are constants, so the compiler keeps them
+ * in immediates instead of loading them from the node arrays. Trees are
+ * written either as nested branches, which visit depth nodes per sample,
+ * or branch free, which evaluate every split of the tree and select the
+ * leaf reached with masks; the latter has no data dependent branches and
+ * lets the compiler vectorize over samples, but pays for all the nodes of
+ * a tree and suits shallow trees.
+ *
+ * The generated source is compiled into a shared library exporting
+ *
+ *   unsigned int icell_kernel_abi();
+ *   unsigned long long icell_forest_fingerprint();
+ *   unsigned int icell_tree_num();
+ *   void icell_leaves(const float* block, size_t stride, size_t n,
+ *                     unsigned int* leaves);
+ *
+ * with icell_leaves following CompiledForest::Leaves, and is loaded by
+ * ForestKernel (forestkernel.h).
+ */
+
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "compiledforest.h"
+
+// version of the interface above, checked when a kernel is loaded
+#define ICELL_KERNEL_ABI 1
+
+enum CodeStyle
+{
+  NestedBranches,
+  BranchFree
+};
+
+// C++ literal of a float threshold that reads back to the same value
+inline std::string FloatLiteral(float value)
+{
+  if (value != value)
+    {
+      return "NAN";
+    }
+  if (value == std::numeric_limits<float>::infinity())
+    {
+      return "HUGE_VALF";
+    }
+  if (value == -std::numeric_limits<float>::infinity())
+    {
+      return "(-HUGE_VALF)";
+    }
+  std::ostringstream literal;
+  literal.precision(9);
+  literal << std::showpoint << value << "f";
+  return literal.str();
+}
+
+// nested if/else of the subtree rooted at node, the true response (right
+// child) first
+inline void WriteNestedNode(const CompiledForest<float>& forest, unsigned int node,
+                            int depth, std::ostream& os)
+{
+  std::string indent(2 * depth + 2, ' ');
+  if (forest.axis_[node] < 0)
+    {
+      os << indent << "return " << forest.child_[node] << "u;\n";
+      return;
+    }
+  os << indent << "if (x[" << forest.axis_[node] << "] < "
+     << FloatLiteral(forest.threshold_[node]) << ")\n";
+  os << indent << "  {\n";
+  WriteNestedNode(forest, forest.child_[node] + 1, depth + 2, os);
+  os << indent << "  }\n";
+  os << indent << "else\n";
+  os << indent << "  {\n";
+  WriteNestedNode(forest, forest.child_[node], depth + 2, os);
+  os << indent << "  }\n";
+}
+
+// every node of the tree gets a reach flag r<node> (1 if the sample goes
+// through it), the leaf id is the sum of the leaves' ids times their flags
+inline void WriteBranchFreeTree(const CompiledForest<float>& forest, index_t treeIdx,
+                                std::ostream& os)
+{
+  std::vector<unsigned int> order(1, forest.root_[treeIdx]);
+  os << "  const unsigned int r" << order[0] << " = 1u;\n";
+  os << "  unsigned int leaf = 0u;\n";
+  for (index_t j = 0; j < order.size(); ++j)
+    {
+      unsigned int node = order[j];
+      if (forest.axis_[node] < 0)
+        {
+          os << "  leaf += r" << node << " * " << forest.child_[node] << "u;\n";
+          continue;
+        }
+      unsigned int left = forest.child_[node];
+      os << "  const unsigned int c" << node << " = (x[" << forest.axis_[node] << "] < "
+         << FloatLiteral(forest.threshold_[node]) << ");\n";
+      os << "  const unsigned int r" << left << " = r" << node << " & (c" << node << " ^ 1u);\n";
+      os << "  const unsigned int r" << left + 1 << " = r" << node << " & c" << node << ";\n";
+      order.push_back(left);
+      order.push_back(left + 1);
+    }
+  os << "  return leaf;\n";
+}
+
+inline void WriteForestSource(const CompiledForest<float>& forest, CodeStyle style,
+                              std::ostream& os)
+{
+  os << "// Generated by icell_compile from a forest of " << forest.TreeNum()
+     << " trees and " << forest.LeafNum() << " leaves, do not edit.\n"
+     << "// Leaf ids are those of CompiledForest, tree k sends sample x to\n"
+     << "// the right child of a split when x[axis] < threshold.\n\n"
+     << "#include <math.h>\n"
+     << "#include <stddef.h>\n\n";
+
+  for (index_t k = 0; k < forest.TreeNum(); ++k)
+    {
+      os << "static inline unsigned int Tree" << k << "(const float* x)\n{\n";
+      if (style == BranchFree)
+        {
+          WriteBranchFreeTree(forest, k, os);
+        }
+      else
+        {
+          WriteNestedNode(forest, forest.root_[k], 0, os);
+        }
+      os << "}\n\n";
+    }
+
+  os << "extern \"C\"\n{\n\n"
+     << "unsigned int icell_kernel_abi()\n{\n  return " << ICELL_KERNEL_ABI << "u;\n}\n\n"
+     << "unsigned long long icell_forest_fingerprint()\n{\n  return "
+     << forest.Fingerprint() << "ULL;\n}\n\n"
+     << "unsigned int icell_tree_num()\n{\n  return " << forest.TreeNum() << "u;\n}\n\n"
+     << "void icell_leaves(const float* block, size_t stride, size_t n, unsigned int* leaves)\n{\n";
+  for (index_t k = 0; k < forest.TreeNum(); ++k)
+    {
+      os << "  for (size_t i = 0; i < n; ++i)\n"
+         << "    {\n"
+         << "      leaves[" << k << " * n + i] = Tree" << k << "(block + i * stride);\n"
+         << "    }\n";
+    }
+  os << "}\n\n} // extern \"C\"\n";
+}
+
+#endif // CODEGEN_H
@@ -0,0 +1,89 @@
+/**
+ * Define the feature major store training reads features from.
+ *
+ * MLData keeps a sample per row, every row its own vector behind a checked
+ * operator[]. Training scans one feature over the samples of a node
+ * instead, so the trainer copies the features once into a ColumnStore: a
+ * single buffer in which every feature is a column of its own, the columns
+ * 64 byte aligned and padded to a whole number of cache lines. Samples are
+ * numbered with 32 bits, half the index traffic of size_t, and read
+ * without checks; the store is built from at most 2^32 - 1 samples.
+ */
+
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include <stdint.h>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "data.h"
+
+typedef uint32_t sample_t;
+
+template<class dataT>
+class ColumnStore
+{
+public:
+  static const size_t alignment = 64;
+
+  ColumnStore(): dataNum_(0), dataDim_(0), stride_(0), offset_(0) {}
+
+  template<class labelT>
+  ColumnStore(const MLData<dataT, labelT>& data): dataNum_(0), dataDim_(0), stride_(0), offset_(0)
+  {
+    Assign(data);
+  }
+
+  // copy the features of data, feature f of sample i at Column(f)[i]
+  template<class labelT>
+  void Assign(const MLData<dataT, labelT>& data)
+  {
+    if (data.Size() >= (size_t)std::numeric_limits<sample_t>::max())
+      {
+        throw std::runtime_error("ColumnStore numbers samples with 32 bits\n");
+      }
+    dataNum_ = data.Size();
+    dataDim_ = data.Dimension();
+    size_t lineNum = alignment / sizeof(dataT);
+    stride_ = (dataNum_ + lineNum - 1) / lineNum * lineNum;
+    buffer_.assign(stride_ * dataDim_ + lineNum, dataT());
+    offset_ = ((alignment - (size_t)&buffer_[0] % alignment) % alignment) / sizeof(dataT);
+
+    for (index_t i = 0; i < dataNum_; ++i)
+      {
+        const std::vector<dataT>& row = data.data[i];
+        for (index_t f = 0; f < dataDim_; ++f)
+          {
+            buffer_[offset_ + f * stride_ + i] = row[f];
+          }
+      }
+  }
+
+  size_t Size() const { return dataNum_; }
+  size_t Dimension() const { return dataDim_; }
+
+  // the samples of feature f, contiguous
+  const dataT* Column(index_t f) const
+  {
+    return &buffer_[offset_ + f * stride_];
+  }
+
+  const dataT& operator()(sample_t i, index_t f) const
+  {
+    return buffer_[offset_ + f * stride_ + i];
+  }
+
+private:
+  // the columns are aligned within buffer_, a copy would not be
+  ColumnStore(const ColumnStore&); //purposely not implemented
+  void operator=(const ColumnStore&); //purposely not implemented
+
+  std::vector<dataT> buffer_;
+  size_t dataNum_;
+  size_t dataDim_;
+  size_t stride_;                       // distance between the columns
+  size_t offset_;                       // first column in buffer_
+};
+
+#endif // COLUMNSTORE_H
@@ -0,0 +1,321 @@
+/**
+ * Define a flattened, pointer-free form of an axis-aligned decision forest
+ * used at inference time.
+ *
+ * Nodes of every tree are stored in contiguous arrays (split axis, threshold,
+ * child offset) instead of heap-allocated virtual Node objects. The two
+ * children of a split node are stored next to each other, so the result of
+ * the classifier response (1 goes to the right child, as Partition does)
+ * is added to the child offset to select the next node. A leaf is
+ * marked by a negative axis and its child offset holds the leaf id, which
+ * indexes a single table of per-class leaf probabilities. The same table is
+ * also kept in 16 and 8 bit fixed point and as the most probable class of
+ * every leaf, for the quantized vote modes below.
+ */
+
+#ifndef COMPILEDFOREST_H
+#define COMPILEDFOREST_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <stdexcept>
+#include <cmath>
+#include "forest.h"
+#include "classifier.h"
+#include "traversal.h"
+
+// Smallest value of type T not below threshold. For a feature x of type T,
+// (x < threshold) and (x < RoundUpThreshold<T>(threshold)) always agree,
+// so storing thresholds in the (narrower) feature type keeps results exact.
+template<class T>
+inline T RoundUpThreshold(double threshold)
+{
+  if (threshold > std::numeric_limits<T>::max())
+    {
+      return std::numeric_limits<T>::infinity();
+    }
+  T t = static_cast<T>(threshold);
+  if (static_cast<double>(t) < threshold)
+    {
+      t = std::nextafter(t, std::numeric_limits<T>::infinity());
+    }
+  return t;
+}
+
+// How leaf votes are stored and summed at prediction time.
+// ExactVote sums the double leaf probabilities.
+// Fixed16Vote and Fixed8Vote store every probability rounded to a multiple
+// of 1/65535 or 1/255 and sum them in integer counters. Each stored value is
+// within half a step of the exact one, so the averaged soft prediction is
+// within 1/131070 (Fixed16Vote) or 1/510 (Fixed8Vote) of the exact one, and
+// the hard label can only change where the two best classes are closer than
+// twice that bound.
+// HardVote stores only the most probable class of each leaf and counts the
+// trees voting for each class (majority vote); its soft prediction is the
+// fraction of trees and is not bounded by the exact one.
+enum VoteMode
+{
+  ExactVote,
+  Fixed16Vote,
+  Fixed8Vote,
+  HardVote
+};
+
+// true when the votes of treeNum trees can be summed as given by vote.
+// Fixed16Vote adds up to 65535 per tree in 32 bit counters, which hold the
+// votes of at most 65537 trees; the other modes widen their counters
+inline bool VoteSumFits(VoteMode vote, size_t treeNum)
+{
+  return (vote != Fixed16Vote) || (treeNum <= 65537);
+}
+
+template<class dataT>
+class CompiledForest
+{
+public:
+  typedef unsigned int offset_t;
+
+  CompiledForest(): classNum_(0), simd_(DetectSimdLevel()) {}
+
+  template<class S, class labelT>
+  CompiledForest(DecisionForest<S, AxisAlignedClassifier<dataT, labelT>, dataT>& forest)
+    : classNum_(0), simd_(DetectSimdLevel())
+  {
+    Build(forest);
+  }
+
+  template<class S, class labelT>
+  void Build(DecisionForest<S, AxisAlignedClassifier<dataT, labelT>, dataT>& forest)
+  {
+    typedef DecisionTree<S, AxisAlignedClassifier<dataT, labelT>, dataT> DecisionTreeT;
+    typedef typename DecisionTreeT::LeafT LeafT;
+    typedef typename DecisionTreeT::SplitT SplitT;
+
+    axis_.clear();
+    threshold_.clear();
+    child_.clear();
+    root_.clear();
+    leafBegin_.clear();
+    leafNode_.clear();
+    leafProb_.clear();
+    leafVote16_.clear();
+    leafVote8_.clear();
+    leafClass_.clear();
+    remainingSwing_.clear();
+
+    classNum_ = 0;
+    for (index_t i = 0; i < forest.trees_.size(); ++i)
+      {
+        std::vector<Node*>& nodes = forest.trees_[i]->nodes_;
+        for (index_t j = 0; j < nodes.size(); ++j)
+          {
+            if (nodes[j]->IsLeaf() &&
+                (((LeafT*)nodes[j])->statistics_.prob_.size() > classNum_))
+              {
+                classNum_ = ((LeafT*)nodes[j])->statistics_.prob_.size();
+              }
+          }
+      }
+
+    // siblings are laid out next to each other in breadth first order
+    offset_t leafNum = 0;
+    std::vector<Node*> order;
+    for (index_t i = 0; i < forest.trees_.size(); ++i)
+      {
+        std::vector<Node*>& nodes = forest.trees_[i]->nodes_;
+        if (nodes.size() == 0)
+          {
+            throw std::runtime_error("CompiledForest: empty tree in forest");
+          }
+        offset_t base = axis_.size();
+        double swing = 0;
+        root_.push_back(base);
+        leafBegin_.push_back(leafNum);
+        order.clear();
+        order.push_back(nodes[0]);
+        for (index_t j = 0; j < order.size(); ++j)
+          {
+            Node* cNode = order[j];
+            if (cNode->IsLeaf())
+              {
+                const std::vector<double>& prob = ((LeafT*)cNode)->statistics_.prob_;
+                axis_.push_back(-1);
+                threshold_.push_back(0);
+                child_.push_back(leafNum++);
+                leafNode_.push_back(cNode->idx_);
+                for (index_t k = 0; k < classNum_; ++k)
+                  {
+                    double p = (k < prob.size() ? prob[k] : 0.0);
+                    leafProb_.push_back(p);
+                    leafVote16_.push_back((unsigned short)floor(p * 65535 + 0.5));
+                    leafVote8_.push_back((unsigned char)floor(p * 255 + 0.5));
+                  }
+                const double* leafProb = &leafProb_[leafProb_.size() - classNum_];
+                // empty leaves hold no probability and cast no hard vote
+                index_t best = classNum_;
+                double max = 0;
+                double min = 1;
+                for (index_t k = 0; k < classNum_; ++k)
+                  {
+                    if (leafProb[k] > max)
+                      {
+                        max = leafProb[k];
+                        best = k;
+                      }
+                    min = std::min(min, leafProb[k]);
+                  }
+                leafClass_.push_back(best);
+                swing = std::max(swing, max - min);
+              }
+            else
+              {
+                SplitT* split = (SplitT*)cNode;
+                axis_.push_back(split->classifier_.axis_);
+                // no feature is below a NaN threshold nor below -infinity,
+                // which sorts where the QuickScorer and the bins expect it
+                double threshold = split->classifier_.threshold_;
+                if (threshold != threshold)
+                  {
+                    threshold = -std::numeric_limits<double>::infinity();
+                  }
+                threshold_.push_back(RoundUpThreshold<dataT>(threshold));
+                child_.push_back(base + order.size());
+                order.push_back(split->leftChild_);
+                order.push_back(split->rightChild_);
+              }
+          }
+        remainingSwing_.push_back(swing);
+      }
+    leafBegin_.push_back(leafNum);
+    remainingSwing_.push_back(0);
+    for (index_t k = TreeNum(); k > 0; --k)
+      {
+        remainingSwing_[k - 1] += remainingSwing_[k];
+      }
+  }
+
+  size_t TreeNum() const { return root_.size(); }
+  size_t LeafNum() const { return leafBegin_.empty() ? 0 : leafBegin_.back(); }
+  size_t ClassNum() const { return classNum_; }
+
+  // number of leaves of the largest tree
+  size_t MaxTreeLeafNum() const
+  {
+    size_t maxNum = 0;
+    for (index_t k = 0; k < TreeNum(); ++k)
+      {
+        maxNum = std::max<size_t>(maxNum, leafBegin_[k + 1] - leafBegin_[k]);
+      }
+    return maxNum;
+  }
+
+  // leaf id reached in tree treeIdx by the sample whose features are x[0..]
+  template<class RowT>
+  offset_t Leaf(index_t treeIdx, const RowT& x) const
+  {
+    offset_t node = root_[treeIdx];
+    while (axis_[node] >= 0)
+      {
+        node = child_[node] + (x[axis_[node]] < threshold_[node]);
+      }
+    return child_[node];
+  }
+
+  // leaf ids reached in tree treeIdx by the n samples of block, feature f
+  // of sample i being block[i * stride + f]
+  void Leaves(index_t treeIdx, const dataT* block, size_t stride, size_t n,
+              offset_t* leaves) const
+  {
+    TraverseBlock(simd_, root_[treeIdx], &axis_[0], &threshold_[0], &child_[0],
+                  block, stride, n, leaves);
+  }
+
+  // leaf ids reached by the n samples of block in every tree, leaves[k * n + i]
+  // being the leaf of sample i in tree k
+  void Leaves(const dataT* block, size_t stride, size_t n, offset_t* leaves) const
+  {
+    for (index_t k = 0; k < TreeNum(); ++k)
+      {
+        Leaves(k, block, stride, n, leaves + k * n);
+      }
+  }
+
+  const CompiledForest& Forest() const { return *this; }
+
+  // 64-bit FNV-1a hash of the tree structure (split axes, threshold bits,
+  // children and roots); two compiled forests with the same fingerprint
+  // reach the same leaf ids
+  unsigned long long Fingerprint() const
+  {
+    unsigned long long hash = 14695981039346656037ULL;
+    Hash(hash, axis_);
+    Hash(hash, threshold_);
+    Hash(hash, child_);
+    Hash(hash, root_);
+    return hash;
+  }
+
+  // 64-bit FNV-1a hash of tree treeIdx alone, its splits and its leaf
+  // probabilities, with node and leaf ids counted from the tree's first
+  // ones; the same tree hashes the same wherever it is in a forest
+  unsigned long long TreeFingerprint(index_t treeIdx) const
+  {
+    offset_t nodeBegin = root_[treeIdx];
+    offset_t nodeEnd = (treeIdx + 1 < TreeNum()) ? root_[treeIdx + 1] : (offset_t)axis_.size();
+    offset_t leafBegin = leafBegin_[treeIdx];
+    offset_t leafEnd = leafBegin_[treeIdx + 1];
+    std::vector<offset_t> child(child_.begin() + nodeBegin, child_.begin() + nodeEnd);
+    for (index_t j = 0; j < child.size(); ++j)
+      {
+        child[j] -= (axis_[nodeBegin + j] < 0) ? leafBegin : nodeBegin;
+      }
+    unsigned long long hash = 14695981039346656037ULL;
+    Hash(hash, &axis_[nodeBegin], nodeEnd - nodeBegin);
+    Hash(hash, &threshold_[nodeBegin], nodeEnd - nodeBegin);
+    Hash(hash, &child[0], child.size());
+    Hash(hash, LeafProbability(leafBegin), (leafEnd - leafBegin) * classNum_);
+    return hash;
+  }
+
+  // per-class probabilities stored in leaf leafIdx
+  const double* LeafProbability(offset_t leafIdx) const
+  {
+    return &leafProb_[leafIdx * classNum_];
+  }
+
+  std::vector<int> axis_;                   // split feature, negative for leaves
+  std::vector<dataT> threshold_;            // go right when feature < threshold
+  std::vector<offset_t> child_;             // left child (right is next), or leaf id
+  std::vector<offset_t> root_;              // root node of each tree
+  std::vector<offset_t> leafBegin_;         // first leaf id of each tree, plus end
+  std::vector<offset_t> leafNode_;          // index of each leaf in its tree's nodes_
+  std::vector<double> leafProb_;            // leafNum x classNum_ probabilities
+  std::vector<unsigned short> leafVote16_;  // leafProb_ x 65535, rounded
+  std::vector<unsigned char> leafVote8_;    // leafProb_ x 255, rounded
+  std::vector<unsigned short> leafClass_;   // most probable class, classNum_ if none
+  // largest change of the difference between two class sums that trees
+  // k, k+1, ... can still make, plus end sentinel 0
+  std::vector<double> remainingSwing_;
+  size_t classNum_;
+  SimdLevel simd_;                          // kernel used by Leaves
+
+private:
+  template<class T>
+  static void Hash(unsigned long long& hash, const std::vector<T>& values)
+  {
+    Hash(hash, values.empty() ? 0 : &values[0], values.size());
+  }
+
+  template<class T>
+  static void Hash(unsigned long long& hash, const T* values, size_t n)
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+    for (size_t i = 0; i < n * sizeof(T); ++i)
+      {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+  }
+};
+
+#endif // COMPILEDFOREST_H
@@ -0,0 +1,306 @@
+/**
+ * Define strided views over image buffers, used at inference time instead of
+ * copying the features of a region into MLData rows.
+ *
+ * A region of width x height pixels is visited in row-major order, sample i
+ * being pixel (i % width, i / width) of the region. Every feature is its own
+ * buffer (plane) in which consecutive rows are rowStride pixels apart, as in
+ * an ITK image whose buffered region is wider than the region viewed; the
+ * planes need not share the same stride.
+ */
+
+#ifndef FEATUREVIEW_H
+#define FEATUREVIEW_H
+
+#include <vector>
+#include "data.h"
+
+template<class dataT>
+class FeatureView
+{
+public:
+  FeatureView(): width_(1), height_(0) {}
+  FeatureView(size_t width, size_t height): width_(width), height_(height) {}
+
+  // plane points at the first pixel of the region in the feature's buffer
+  void AddFeature(const dataT* plane, size_t rowStride)
+  {
+    planes_.push_back(plane);
+    rowStrides_.push_back(rowStride);
+  }
+
+  size_t Size() const { return width_ * height_; }
+  size_t Dimension() const { return planes_.size(); }
+
+  // copy the features of the n samples from begin into block, feature f of
+  // sample i at block[i * Dimension() + f]
+  void Gather(index_t begin, size_t n, dataT* block) const
+  {
+    size_t dataDim = planes_.size();
+    index_t row = begin / width_;
+    index_t col = begin % width_;
+    for (index_t i = 0; i < n; ++i)
+      {
+        for (index_t f = 0; f < dataDim; ++f)
+          {
+            block[i * dataDim + f] = planes_[f][row * rowStrides_[f] + col];
+          }
+        if (++col == width_)
+          {
+            col = 0;
+            ++row;
+          }
+      }
+  }
+
+  std::vector<const dataT*> planes_;
+  std::vector<size_t> rowStrides_;
+  size_t width_;
+  size_t height_;
+};
+
+// the samples of FeaturesT (see FeatureView) at the given sorted indices
+// only, such as the pixels of a mask, as FeaturesT of
+// Classification::PredictingBlocks. Runs of consecutive indices are
+// gathered at once
+template<class FeaturesT, class dataT>
+class MaskedFeatures
+{
+public:
+  MaskedFeatures(const FeaturesT& features, const std::vector<index_t>& samples)
+    : features_(features), samples_(samples) {}
+
+  size_t Size() const { return samples_.size(); }
+  size_t Dimension() const { return features_.Dimension(); }
+
+  void Gather(index_t begin, size_t n, dataT* block) const
+  {
+    size_t dataDim = features_.Dimension();
+    for (index_t i = 0; i < n; )
+      {
+        size_t run = 1;
+        while ((i + run < n) && (samples_[begin + i + run] == samples_[begin + i] + run))
+          {
+            ++run;
+          }
+        features_.Gather(samples_[begin + i], run, block + i * dataDim);
+        i += run;
+      }
+  }
+
+  const FeaturesT& features_;
+  const std::vector<index_t>& samples_;
+};
+
+// the predictions of the samples of MaskedFeatures, stored at their
+// indices in PredictionsT (see PredictionView)
+template<class PredictionsT>
+class MaskedPredictions
+{
+public:
+  MaskedPredictions(PredictionsT& predictions, const std::vector<index_t>& samples)
+    : predictions_(predictions), samples_(samples) {}
+
+  void Store(index_t i, const double* prediction, size_t classNum, int label)
+  {
+    predictions_.Store(samples_[i], prediction, classNum, label);
+  }
+
+  void StoreLeaves(index_t begin, size_t n, const unsigned int* leaves,
+                   const unsigned int* leafBegin, size_t treeNum)
+  {
+    std::vector<unsigned int> sampleLeaves(treeNum);
+    for (index_t i = 0; i < n; ++i)
+      {
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            sampleLeaves[k] = leaves[k * n + i];
+          }
+        predictions_.StoreLeaves(samples_[begin + i], 1, &sampleLeaves[0], leafBegin, treeNum);
+      }
+  }
+
+  void StoreVoteSums(index_t begin, size_t n, size_t classNum, const double* sums)
+  {
+    for (index_t i = 0; i < n; ++i)
+      {
+        predictions_.StoreVoteSums(samples_[begin + i], 1, classNum, sums + i * classNum);
+      }
+  }
+
+  PredictionsT& predictions_;
+  const std::vector<index_t>& samples_;
+};
+
+// predictions written straight into a label buffer and, if probabilities is
+// not null, a buffer of classNum interleaved components per pixel, both laid
+// out like the FeatureView the samples come from. The leaf reached in every
+// tree and the summed votes can also be kept, see SetLeafIndices and
+// SetVoteSums
+template<class labelOutT, class probT>
+class PredictionView
+{
+public:
+  PredictionView(labelOutT* labels, size_t labelRowStride,
+                 probT* probabilities, size_t probabilityRowStride,
+                 size_t width)
+    : labels_(labels), labelRowStride_(labelRowStride),
+      probabilities_(probabilities), probabilityRowStride_(probabilityRowStride),
+      leafIndices_(0), leafIndexRowStride_(0),
+      voteSums_(0), voteSumRowStride_(0), width_(width) {}
+
+  // buffer of one component per tree and pixel receiving the index of the
+  // pixel's leaf within the tree (leaf id minus the tree's first leaf id)
+  void SetLeafIndices(unsigned short* leafIndices, size_t leafIndexRowStride)
+  {
+    leafIndices_ = leafIndices;
+    leafIndexRowStride_ = leafIndexRowStride;
+  }
+
+  // buffer of classNum interleaved components per pixel receiving the votes
+  // of the trees summed per class, before they are averaged
+  void SetVoteSums(float* voteSums, size_t voteSumRowStride)
+  {
+    voteSums_ = voteSums;
+    voteSumRowStride_ = voteSumRowStride;
+  }
+
+  void Store(index_t i, const double* prediction, size_t classNum, int label)
+  {
+    index_t row = i / width_;
+    index_t col = i % width_;
+    labels_[row * labelRowStride_ + col] = label;
+    if (probabilities_ != 0)
+      {
+        probT* probability = probabilities_ + (row * probabilityRowStride_ + col) * classNum;
+        for (index_t j = 0; j < classNum; ++j)
+          {
+            probability[j] = prediction[j];
+          }
+      }
+  }
+
+  // leaves[k * n + i] is the leaf id of sample begin + i in tree k
+  void StoreLeaves(index_t begin, size_t n, const unsigned int* leaves,
+                   const unsigned int* leafBegin, size_t treeNum)
+  {
+    if (leafIndices_ == 0)
+      {
+        return;
+      }
+    for (index_t i = 0; i < n; ++i)
+      {
+        index_t row = (begin + i) / width_;
+        index_t col = (begin + i) % width_;
+        unsigned short* leafIndex = leafIndices_ + (row * leafIndexRowStride_ + col) * treeNum;
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            leafIndex[k] = leaves[k * n + i] - leafBegin[k];
+          }
+      }
+  }
+
+  void StoreVoteSums(index_t begin, size_t n, size_t classNum, const double* sums)
+  {
+    if (voteSums_ == 0)
+      {
+        return;
+      }
+    for (index_t i = 0; i < n; ++i)
+      {
+        index_t row = (begin + i) / width_;
+        index_t col = (begin + i) % width_;
+        float* voteSum = voteSums_ + (row * voteSumRowStride_ + col) * classNum;
+        for (index_t j = 0; j < classNum; ++j)
+          {
+            voteSum[j] = sums[i * classNum + j];
+          }
+      }
+  }
+
+  labelOutT* labels_;
+  size_t labelRowStride_;
+  probT* probabilities_;
+  size_t probabilityRowStride_;   // in pixels
+  unsigned short* leafIndices_;
+  size_t leafIndexRowStride_;     // in pixels
+  float* voteSums_;
+  size_t voteSumRowStride_;       // in pixels
+  size_t width_;
+};
+
+// leaf indices kept by PredictionView::SetLeafIndices, read back as the
+// leaf ids of a forest with the same trees (leafBegin being its first leaf
+// id of each tree, plus end) for Classification::PredictingCachedLeaves
+class LeafIndexView
+{
+public:
+  LeafIndexView(const unsigned short* leafIndices, size_t rowStride,
+                size_t width, size_t height,
+                const unsigned int* leafBegin, size_t treeNum)
+    : leafIndices_(leafIndices), rowStride_(rowStride), width_(width), height_(height),
+      leafBegin_(leafBegin), treeNum_(treeNum) {}
+
+  size_t Size() const { return width_ * height_; }
+
+  // leaves[k * n + i] is the leaf id of sample begin + i in tree k. False if
+  // an index is beyond its tree's leaves, which a forest with the same trees
+  // cannot have given
+  bool Gather(index_t begin, size_t n, unsigned int* leaves) const
+  {
+    bool valid = true;
+    for (index_t i = 0; i < n; ++i)
+      {
+        index_t row = (begin + i) / width_;
+        index_t col = (begin + i) % width_;
+        const unsigned short* leafIndex = leafIndices_ + (row * rowStride_ + col) * treeNum_;
+        for (index_t k = 0; k < treeNum_; ++k)
+          {
+            unsigned int leaf = leafBegin_[k] + leafIndex[k];
+            valid = valid && (leaf < leafBegin_[k + 1]);
+            leaves[k * n + i] = leaf;
+          }
+      }
+    return valid;
+  }
+
+  const unsigned short* leafIndices_;
+  size_t rowStride_;              // in pixels
+  size_t width_;
+  size_t height_;
+  const unsigned int* leafBegin_;
+  size_t treeNum_;
+};
+
+// vote sums kept by PredictionView::SetVoteSums, read back for
+// Classification::PredictingUpdate
+class VoteSumView
+{
+public:
+  VoteSumView(const float* voteSums, size_t rowStride, size_t width, size_t height)
+    : voteSums_(voteSums), rowStride_(rowStride), width_(width), height_(height) {}
+
+  size_t Size() const { return width_ * height_; }
+
+  // sums[i * classNum + j] is the vote sum of class j of sample begin + i
+  void Gather(index_t begin, size_t n, size_t classNum, double* sums) const
+  {
+    for (index_t i = 0; i < n; ++i)
+      {
+        index_t row = (begin + i) / width_;
+        index_t col = (begin + i) % width_;
+        const float* voteSum = voteSums_ + (row * rowStride_ + col) * classNum;
+        for (index_t j = 0; j < classNum; ++j)
+          {
+            sums[i * classNum + j] = voteSum[j];
+          }
+      }
+  }
+
+  const float* voteSums_;
+  size_t rowStride_;              // in pixels
+  size_t width_;
+  size_t height_;
+};
+
+#endif // FEATUREVIEW_H
@@ -1,6 +1,6 @@
 /**
  * Define decision forest as a vector of decision tree's pointer,
- * testing processing runs in parallel by openMP.
+ * testing processing runs in parallel over tiles of samples by openMP.
  */
 
 #ifndef FOREST_H
@@ -32,35 +32,54 @@ public:
     return ctree;
   }
 
+  // samples are split into tiles small enough to stay in cache, and every
+  // tree is applied to a tile before moving on to the next one. Tiles are
+  // processed in parallel, so the work scales with the data rather than
+  // with the number of trees
   void Apply(MLData<dataT, S*>& testingData,
              Vector<Vector<S*> >& testingResult)
   {
+    static const size_t tileSize = 1024;
     size_t treeNum = trees_.size();
     size_t dataNum = testingData.Size();
+    size_t tileNum = (dataNum + tileSize - 1) / tileSize;
 
     testingResult.Resize(treeNum);
-    #pragma omp parallel for
-    for (index_t i = 0; i < treeNum; ++i)
+    for (index_t k = 0; k < treeNum; ++k)
+      {
+        testingResult[k].Resize(dataNum);
+      }
+    #pragma omp parallel for schedule(dynamic)
+    for (index_t t = 0; t < tileNum; ++t)
       {
-        testingResult[i].Resize(dataNum);
-        trees_[i]->Apply(testingData, testingResult[i]);
+        index_t begin = t * tileSize;
+        index_t end = std::min(begin + tileSize, dataNum);
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            Vector<S*>& result = testingResult[k];
+            for (index_t i = begin; i < end; ++i)
+              {
+                result[i] = trees_[k]->Leaf(testingData, i);
+              }
+          }
       }
   }
 
   // Added by Paul. This version of the method allows the same testingResult
   // vector to be reused. For speed, it does not check that the size of the
   // testing result is sufficient
-  // This version of the method takes a preallocated vector
-  // index and a preallocated vector response_vec of the same size as
+  // This version of the method takes preallocated vectors
+  // index, response and scratch of the same size as
   // testingData. It does not do allocation to save on computation time
   void ApplyFast(MLData<dataT, S*>& testingData,
                  Vector<Vector<S*> >& testingResult,
                  std::vector<index_t> &index,
-                 std::vector<bool> &response)
+                 std::vector<unsigned char> &response,
+                 std::vector<index_t> &scratch)
   {
     size_t treeNum = trees_.size();
     for (index_t i = 0; i < treeNum; ++i)
-        trees_[i]->ApplyFast(testingData, testingResult[i], index, response);
+        trees_[i]->ApplyFast(testingData, testingResult[i], index, response, scratch);
   }
 
   void Print(int level)
@@ -0,0 +1,107 @@
+/**
+ * Define a forest evaluator loaded from a shared library generated by
+ * icell_compile (see codegen.h).
+ *
+ * The library gives the leaf ids of a block of samples in every tree, the
+ * leaf tables stay in the compiled forest. Loading checks the library's
+ * interface version and that it was generated from a forest with the same
+ * fingerprint, so its leaf ids index the same tables.
+ */
+
+#ifndef FORESTKERNEL_H
+#define FORESTKERNEL_H
+
+#include <dlfcn.h>
+#include <stdexcept>
+#include <string>
+#include "compiledforest.h"
+#include "codegen.h"
+
+class ForestKernel
+{
+public:
+  typedef CompiledForest<float> CompiledForestT;
+  typedef CompiledForestT::offset_t offset_t;
+
+  ForestKernel(): handle_(0), leaves_(0), forest_(0) {}
+  ~ForestKernel() { Unload(); }
+
+  void Load(const std::string& fileName, const CompiledForestT& forest)
+  {
+    Unload();
+    handle_ = dlopen(fileName.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle_ == 0)
+      {
+        throw std::runtime_error("ForestKernel: cannot load " + fileName + ": " + dlerror());
+      }
+
+    typedef unsigned int (*AbiFunction)();
+    typedef unsigned long long (*FingerprintFunction)();
+    typedef unsigned int (*TreeNumFunction)();
+    AbiFunction abi = (AbiFunction)Symbol("icell_kernel_abi");
+    FingerprintFunction fingerprint = (FingerprintFunction)Symbol("icell_forest_fingerprint");
+    TreeNumFunction treeNum = (TreeNumFunction)Symbol("icell_tree_num");
+    LeavesFunction leaves = (LeavesFunction)Symbol("icell_leaves");
+    if (abi() != ICELL_KERNEL_ABI)
+      {
+        Unload();
+        throw std::runtime_error("ForestKernel: " + fileName + " was generated for another interface version");
+      }
+    if ((treeNum() != forest.TreeNum()) || (fingerprint() != forest.Fingerprint()))
+      {
+        Unload();
+        throw std::runtime_error("ForestKernel: " + fileName + " was generated from another forest");
+      }
+    leaves_ = leaves;
+    forest_ = &forest;
+    fileName_ = fileName;
+  }
+
+  void Unload()
+  {
+    if (handle_ != 0)
+      {
+        dlclose(handle_);
+      }
+    handle_ = 0;
+    leaves_ = 0;
+    forest_ = 0;
+    fileName_.clear();
+  }
+
+  bool IsLoaded() const { return leaves_ != 0; }
+  const std::string& FileName() const { return fileName_; }
+
+  // leaf ids reached by the n samples of block in every tree, as
+  // CompiledForest::Leaves
+  void Leaves(const float* block, size_t stride, size_t n, offset_t* leaves) const
+  {
+    leaves_(block, stride, n, leaves);
+  }
+
+  const CompiledForestT& Forest() const { return *forest_; }
+
+private:
+  typedef void (*LeavesFunction)(const float*, size_t, size_t, unsigned int*);
+
+  ForestKernel(const ForestKernel&);
+  void operator=(const ForestKernel&);
+
+  void* Symbol(const char* name)
+  {
+    void* symbol = dlsym(handle_, name);
+    if (symbol == 0)
+      {
+        Unload();
+        throw std::runtime_error(std::string("ForestKernel: missing symbol ") + name);
+      }
+    return symbol;
+  }
+
+  void* handle_;
+  LeavesFunction leaves_;
+  const CompiledForestT* forest_;
+  std::string fileName_;
+};
+
+#endif // FORESTKERNEL_H
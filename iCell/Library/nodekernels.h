@@ -0,0 +1,149 @@
+/**
+ * Define kernels for the loops training and DecisionTree::Travel run at
+ * every node.
+ *
+ * Bucketing puts each feature response of a node in the bucket of the
+ * sorted candidate thresholds it falls between: the number of thresholds
+ * it is not below, counted without a branch per threshold. On x86 the AVX2
+ * and AVX-512 kernels compare 4 or 8 responses with each threshold at once
+ * and count the lanes at or above it. A NaN response is never at or above a
+ * threshold, so it falls in the first bucket, as in the scalar loop.
+ *
+ * Partition is stable and branch free over byte responses: every index is
+ * written at both the false and the true cursor, and only one of them moves.
+ * The false indices are compacted in place, the true ones are gathered in a
+ * scratch buffer and copied after them.
+ */
+
+#ifndef NODEKERNELS_H
+#define NODEKERNELS_H
+
+#include <algorithm>
+#include <vector>
+#include "data.h"
+#include "traversal.h"
+
+// bucket of each of the n responses against the thresholdNum sorted
+// thresholds
+inline void BucketScalar(const double* responses, size_t n,
+                         const double* thresholds, size_t thresholdNum,
+                         unsigned int* buckets)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      unsigned int which = 0;
+      for (size_t k = 0; k < thresholdNum; ++k)
+        {
+          which += (responses[i] >= thresholds[k]);
+        }
+      buckets[i] = which;
+    }
+}
+
+#ifdef ICELL_SIMD_X86
+__attribute__((target("avx2")))
+inline void BucketAVX2(const double* responses, size_t n,
+                       const double* thresholds, size_t thresholdNum,
+                       unsigned int* buckets)
+{
+  const __m256i lowHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256d x0 = _mm256_loadu_pd(responses + i);
+      __m256d x1 = _mm256_loadu_pd(responses + i + 4);
+      __m256i count0 = _mm256_setzero_si256();
+      __m256i count1 = _mm256_setzero_si256();
+      for (size_t k = 0; k < thresholdNum; ++k)
+        {
+          // all ones (-1) in the lanes at or above the threshold
+          __m256d t = _mm256_set1_pd(thresholds[k]);
+          count0 = _mm256_sub_epi64(count0, _mm256_castpd_si256(_mm256_cmp_pd(x0, t, _CMP_GE_OQ)));
+          count1 = _mm256_sub_epi64(count1, _mm256_castpd_si256(_mm256_cmp_pd(x1, t, _CMP_GE_OQ)));
+        }
+      _mm_storeu_si128((__m128i*)(buckets + i),
+                       _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(count0, lowHalves)));
+      _mm_storeu_si128((__m128i*)(buckets + i + 4),
+                       _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(count1, lowHalves)));
+    }
+  BucketScalar(responses + i, n - i, thresholds, thresholdNum, buckets + i);
+}
+
+__attribute__((target("avx512f")))
+inline void BucketAVX512(const double* responses, size_t n,
+                         const double* thresholds, size_t thresholdNum,
+                         unsigned int* buckets)
+{
+  const __m512i one = _mm512_set1_epi64(1);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      __m512d x0 = _mm512_loadu_pd(responses + i);
+      __m512d x1 = _mm512_loadu_pd(responses + i + 8);
+      __m512i count0 = _mm512_setzero_si512();
+      __m512i count1 = _mm512_setzero_si512();
+      for (size_t k = 0; k < thresholdNum; ++k)
+        {
+          __m512d t = _mm512_set1_pd(thresholds[k]);
+          count0 = _mm512_mask_add_epi64(count0, _mm512_cmp_pd_mask(x0, t, _CMP_GE_OQ), count0, one);
+          count1 = _mm512_mask_add_epi64(count1, _mm512_cmp_pd_mask(x1, t, _CMP_GE_OQ), count1, one);
+        }
+      // narrowed into a zeroed destination, the unmasked form leaves it
+      // uninitialized in GCC's intrinsics and warns
+      const __m256i zero = _mm256_setzero_si256();
+      _mm256_storeu_si256((__m256i*)(buckets + i), _mm512_mask_cvtepi64_epi32(zero, 0xff, count0));
+      _mm256_storeu_si256((__m256i*)(buckets + i + 8), _mm512_mask_cvtepi64_epi32(zero, 0xff, count1));
+    }
+  BucketScalar(responses + i, n - i, thresholds, thresholdNum, buckets + i);
+}
+#endif
+
+// bucket of each of the n responses against the thresholdNum sorted
+// thresholds: the number of thresholds the response is not below
+inline void BucketResponses(SimdLevel level, const double* responses, size_t n,
+                            const double* thresholds, size_t thresholdNum,
+                            unsigned int* buckets)
+{
+#ifdef ICELL_SIMD_X86
+  if (level == SimdAVX512)
+    {
+      BucketAVX512(responses, n, thresholds, thresholdNum, buckets);
+      return;
+    }
+  if (level == SimdAVX2)
+    {
+      BucketAVX2(responses, n, thresholds, thresholdNum, buckets);
+      return;
+    }
+#endif
+  BucketScalar(responses, n, thresholds, thresholdNum, buckets);
+}
+
+// reorder index[begin, end), of any index type, so that the indices
+// responding false come first and those responding true after them, each
+// kept in their order, and return where the true ones begin. scratch is
+// used over [begin, end), so concurrent tasks may share it as they share
+// index; response is left as it is
+template<class R, class I>
+inline std::size_t Partition(const R& response,
+                             std::vector<I>& index,
+                             index_t begin,
+                             index_t end,
+                             std::vector<I>& scratch)
+{
+  index_t falseEnd = begin;
+  index_t trueEnd = begin;
+  for (index_t i = begin; i < end; ++i)
+    {
+      I idx = index[i];
+      index_t side = (response[i] != 0);
+      index[falseEnd] = idx;
+      scratch[trueEnd] = idx;
+      falseEnd += 1 - side;
+      trueEnd += side;
+    }
+  std::copy(scratch.begin() + begin, scratch.begin() + trueEnd, index.begin() + falseEnd);
+  return falseEnd;
+}
+
+#endif // NODEKERNELS_H
@@ -0,0 +1,292 @@
+/**
+ * Define a QuickScorer evaluator for compiled axis-aligned forests.
+ *
+ * Instead of walking nodes, every leaf of a tree owns one bit of a bitvector
+ * (leaves numbered from left to right) and the exit leaf of a sample is the
+ * leftmost bit still set once all "false" nodes have been applied. A split
+ * node is false when the sample goes to its right child, and applying it
+ * ANDs the tree's bitvector with a precomputed mask that clears the leaves of
+ * its left subtree. Thresholds of all trees are sorted per feature in
+ * decreasing order, so the false nodes of a sample are found by scanning each
+ * feature's list until the first threshold the feature value is not below.
+ * Trees with more than 64 leaves use several 64-bit words per bitvector.
+ */
+
+#ifndef QUICKSCORER_H
+#define QUICKSCORER_H
+
+#include <algorithm>
+#include <vector>
+#include "compiledforest.h"
+
+typedef unsigned long long bitvector_t;
+
+inline unsigned int LowestBit(bitvector_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(word);
+#else
+  unsigned int bit = 0;
+  while ((word & 1) == 0)
+    {
+      word >>= 1;
+      ++bit;
+    }
+  return bit;
+#endif
+}
+
+template<class dataT>
+class QuickScorer
+{
+public:
+  typedef CompiledForest<dataT> CompiledForestT;
+  typedef typename CompiledForestT::offset_t offset_t;
+
+  QuickScorer(): forest_(0), featureNum_(0) {}
+  QuickScorer(const CompiledForestT& forest): forest_(0), featureNum_(0)
+  {
+    Build(forest);
+  }
+
+  void Build(const CompiledForestT& forest)
+  {
+    forest_ = &forest;
+    size_t treeNum = forest.TreeNum();
+
+    featureNum_ = 0;
+    for (index_t i = 0; i < forest.axis_.size(); ++i)
+      {
+        if (forest.axis_[i] + 1 > (int)featureNum_)
+          {
+            featureNum_ = forest.axis_[i] + 1;
+          }
+      }
+
+    wordBegin_.resize(treeNum + 1);
+    leafId_.resize(forest.LeafNum());
+    wordBegin_[0] = 0;
+    std::vector<NodeMasks> nodes;
+    for (index_t t = 0; t < treeNum; ++t)
+      {
+        size_t leafNum = forest.leafBegin_[t + 1] - forest.leafBegin_[t];
+        wordBegin_[t + 1] = wordBegin_[t] + (leafNum + 63) / 64;
+        offset_t leafCount = 0;
+        InOrder(forest, t, forest.root_[t], leafCount, nodes);
+      }
+
+    // sort every feature's false-node candidates by decreasing threshold
+    std::sort(nodes.begin(), nodes.end());
+    featureBegin_.assign(featureNum_ + 1, 0);
+    threshold_.resize(nodes.size());
+    maskBegin_.resize(nodes.size() + 1);
+    maskWord_.clear();
+    mask_.clear();
+    for (index_t i = 0; i < nodes.size(); ++i)
+      {
+        ++featureBegin_[nodes[i].axis + 1];
+        threshold_[i] = nodes[i].threshold;
+        maskBegin_[i] = mask_.size();
+        for (offset_t leaf = nodes[i].leftBegin; leaf < nodes[i].leftEnd; )
+          {
+            offset_t word = leaf / 64;
+            offset_t last = std::min<offset_t>(nodes[i].leftEnd, (word + 1) * 64);
+            bitvector_t clear = 0;
+            for (; leaf < last; ++leaf)
+              {
+                clear |= (bitvector_t)1 << (leaf % 64);
+              }
+            maskWord_.push_back(wordBegin_[nodes[i].tree] + word);
+            mask_.push_back(~clear);
+          }
+      }
+    maskBegin_[nodes.size()] = mask_.size();
+    for (index_t f = 0; f < featureNum_; ++f)
+      {
+        featureBegin_[f + 1] += featureBegin_[f];
+      }
+  }
+
+  size_t TreeNum() const { return forest_->TreeNum(); }
+  size_t WordNum() const { return wordBegin_.back(); }
+
+  // compiled leaf ids reached in every tree by the sample x, using the
+  // caller's scratch bitvectors of WordNum() words
+  void Leaves(const dataT* x, offset_t* leaves, bitvector_t* bits) const
+  {
+    std::fill(bits, bits + WordNum(), ~(bitvector_t)0);
+    for (index_t f = 0; f < featureNum_; ++f)
+      {
+        for (offset_t i = featureBegin_[f]; i < featureBegin_[f + 1]; ++i)
+          {
+            if (!(x[f] < threshold_[i]))
+              {
+                break;
+              }
+            for (offset_t m = maskBegin_[i]; m < maskBegin_[i + 1]; ++m)
+              {
+                bits[maskWord_[m]] &= mask_[m];
+              }
+          }
+      }
+    size_t treeNum = TreeNum();
+    for (index_t t = 0; t < treeNum; ++t)
+      {
+        offset_t word = wordBegin_[t];
+        while (bits[word] == 0)
+          {
+            ++word;
+          }
+        offset_t local = (word - wordBegin_[t]) * 64 + LowestBit(bits[word]);
+        leaves[t] = leafId_[forest_->leafBegin_[t] + local];
+      }
+  }
+
+  // compiled leaf ids reached by the n samples of block (feature f of
+  // sample i at block[i * stride + f]) in every tree, leaves[k * n + i]
+  // being the leaf of sample i in tree k
+  void Leaves(const dataT* block, size_t stride, size_t n, offset_t* leaves) const
+  {
+    size_t treeNum = TreeNum();
+    std::vector<bitvector_t> bits(WordNum());
+    std::vector<offset_t> sampleLeaves(treeNum);
+    for (index_t i = 0; i < n; ++i)
+      {
+        Leaves(block + i * stride, &sampleLeaves[0], &bits[0]);
+        for (index_t k = 0; k < treeNum; ++k)
+          {
+            leaves[k * n + i] = sampleLeaves[k];
+          }
+      }
+  }
+
+  const CompiledForestT& Forest() const { return *forest_; }
+
+  const CompiledForestT* forest_;
+  size_t featureNum_;
+  std::vector<offset_t> featureBegin_;  // first entry of each feature, plus end
+  std::vector<dataT> threshold_;        // decreasing within each feature
+  std::vector<offset_t> maskBegin_;     // first mask of each entry, plus end
+  std::vector<offset_t> maskWord_;      // bitvector word a mask applies to
+  std::vector<bitvector_t> mask_;       // clears the left subtree's leaves
+  std::vector<offset_t> wordBegin_;     // first bitvector word of each tree
+  std::vector<offset_t> leafId_;        // left-to-right leaf -> compiled leaf id
+
+private:
+  struct NodeMasks
+  {
+    int axis;
+    dataT threshold;
+    offset_t tree;
+    offset_t leftBegin;
+    offset_t leftEnd;
+
+    bool operator<(const NodeMasks& other) const
+    {
+      if (axis != other.axis)
+        {
+          return axis < other.axis;
+        }
+      return threshold > other.threshold;
+    }
+  };
+
+  // number the leaves of a tree from left to right and record, for every
+  // split node, the range of leaves in its left subtree
+  void InOrder(const CompiledForestT& forest, offset_t tree, offset_t node,
+               offset_t& leafCount, std::vector<NodeMasks>& nodes)
+  {
+    if (forest.axis_[node] < 0)
+      {
+        leafId_[forest.leafBegin_[tree] + leafCount] = forest.child_[node];
+        ++leafCount;
+        return;
+      }
+    NodeMasks split;
+    split.axis = forest.axis_[node];
+    split.threshold = forest.threshold_[node];
+    split.tree = tree;
+    split.leftBegin = leafCount;
+    InOrder(forest, tree, forest.child_[node], leafCount, nodes);
+    split.leftEnd = leafCount;
+    InOrder(forest, tree, forest.child_[node] + 1, leafCount, nodes);
+    nodes.push_back(split);
+  }
+};
+
+// number of (tree, sample) pairs of testingData whose QuickScorer exit leaf
+// differs from the leaf DecisionTree::Apply reaches in the original forest
+template<class S, class labelT, class dataT>
+size_t CheckQuickScorerLeaves(DecisionForest<S, AxisAlignedClassifier<dataT, labelT>, dataT>& forest,
+                              const QuickScorer<dataT>& scorer,
+                              MLData<dataT, S*>& testingData)
+{
+  typedef DecisionTree<S, AxisAlignedClassifier<dataT, labelT>, dataT> DecisionTreeT;
+  typedef typename DecisionTreeT::LeafT LeafT;
+  typedef typename QuickScorer<dataT>::offset_t offset_t;
+
+  size_t treeNum = forest.trees_.size();
+  size_t dataNum = testingData.Size();
+  size_t dataDim = testingData.Dimension();
+  if (treeNum != scorer.TreeNum())
+    {
+      throw std::runtime_error("CheckQuickScorerLeaves: tree number differs from forest");
+    }
+
+  std::vector<offset_t> leaves(dataNum * treeNum);
+  std::vector<dataT> row(dataDim);
+  std::vector<bitvector_t> bits(scorer.WordNum());
+  for (index_t i = 0; i < dataNum; ++i)
+    {
+      std::copy(testingData.data[i].begin(), testingData.data[i].begin() + dataDim, row.begin());
+      scorer.Leaves(&row[0], &leaves[i * treeNum], &bits[0]);
+    }
+
+  size_t mismatch = 0;
+  Vector<S*> testingResult;
+  testingResult.Resize(dataNum);
+  for (index_t k = 0; k < treeNum; ++k)
+    {
+      forest.trees_[k]->Apply(testingData, testingResult);
+      for (index_t i = 0; i < dataNum; ++i)
+        {
+          Node* node = forest.trees_[k]->nodes_[scorer.forest_->leafNode_[leaves[i * treeNum + k]]];
+          if (&(((LeafT*)node)->statistics_) != testingResult[i])
+            {
+              ++mismatch;
+            }
+        }
+    }
+  return mismatch;
+}
+
+// number of (tree, sample) pairs whose QuickScorer exit leaf differs from
+// the leaf DecisionTree::Apply reaches in the original forest, over the
+// samples of testingData and over them again with feature i % dim of sample
+// i not a number, which no split finds below its threshold
+template<class S, class labelT, class dataT>
+size_t CheckQuickScorer(DecisionForest<S, AxisAlignedClassifier<dataT, labelT>, dataT>& forest,
+                        const QuickScorer<dataT>& scorer,
+                        MLData<dataT, S*>& testingData)
+{
+  size_t mismatch = CheckQuickScorerLeaves(forest, scorer, testingData);
+
+  size_t dataNum = testingData.Size();
+  size_t dataDim = testingData.Dimension();
+  if (dataDim == 0)
+    {
+      return mismatch;
+    }
+  MLData<dataT, S*> nanData(dataNum, dataDim);
+  for (index_t i = 0; i < dataNum; ++i)
+    {
+      for (index_t f = 0; f < dataDim; ++f)
+        {
+          nanData.data[i][f] = testingData.data[i][f];
+        }
+      nanData.data[i][i % dataDim] = std::numeric_limits<dataT>::quiet_NaN();
+    }
+  return mismatch + CheckQuickScorerLeaves(forest, scorer, nanData);
+}
+
+#endif // QUICKSCORER_H
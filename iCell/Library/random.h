@@ -1,11 +1,18 @@
 /**
  * Define random number generator.
+ *
+ * The generator is xoshiro256**, its state kept in the object instead of
+ * the global state of rand(): every tree, and every task within a tree,
+ * draws from a stream of its own, so no generator is shared between threads
+ * and a stream gives the same numbers whatever thread draws them. The state
+ * is filled by splitmix64 from a seed and a stream number, such as the
+ * index of a tree.
  */
 
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#include <cstdlib>
+#include <stdint.h>
 #include <time.h>
 
 class Random
@@ -13,33 +20,85 @@ class Random
 public:
   Random()
   {
-    srand(time(NULL));
+    Seed(time(NULL), 0);
   }
 
   Random(unsigned int seed)
   {
-    srand(seed);
+    Seed(seed, 0);
   }
 
+  Random(uint64_t seed, uint64_t stream)
+  {
+    Seed(seed, stream);
+  }
+
+  // a stream of its own for a part of the work, such as a subtree, drawn
+  // from this one. The part gets the same numbers whenever it is done
+  Random Fork()
+  {
+    uint64_t seed = Next();
+    uint64_t stream = Next();
+    return Random(seed, stream);
+  }
+
+  // in [0, 2^31), the range of rand()
   int RandI()
   {
-    return rand();
+    return Next() >> 33;
   }
 
+  // in [min, max)
   int RandI(int min, int max)
   {
-    return min + rand() % (max-min);
+    return min + (int)(((Next() >> 32) * (uint64_t)(max - min)) >> 32);
   }
 
+  // in [0, 1)
   double RandD()
   {
-    return (double) rand() / RAND_MAX;
+    return (Next() >> 11) * (1.0 / 9007199254740992.0);
   }
 
+  // in [min, max)
   double RandD(double min, double max)
   {
-    return min + ((double)rand()/RAND_MAX) * (max-min);
+    return min + RandD() * (max - min);
+  }
+
+  uint64_t Next()
+  {
+    uint64_t result = Rotl(state_[1] * 5, 7) * 9;
+    uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = Rotl(state_[3], 45);
+    return result;
+  }
+
+private:
+  void Seed(uint64_t seed, uint64_t stream)
+  {
+    uint64_t x = seed ^ (stream * 0xd1b54a32d192ed03ULL);
+    for (int i = 0; i < 4; ++i)
+      {
+        x += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        state_[i] = z ^ (z >> 31);
+      }
   }
+
+  static uint64_t Rotl(uint64_t x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t state_[4];
 };
 
 #endif // RANDOM_H
@@ -76,6 +76,26 @@ public:
     sampleNum_ += hist.sampleNum_;
   }
 
+  // aggregate class counts kept outside a histogram, one per bin
+  void Aggregate(const size_t* counts)
+  {
+    for(int i = 0; i < bins_.size(); ++i)
+      {
+        bins_[i] += counts[i];
+        sampleNum_ += counts[i];
+      }
+  }
+
+  // take out class counts aggregated into this histogram
+  void Subtract(const size_t* counts)
+  {
+    for(int i = 0; i < bins_.size(); ++i)
+      {
+        bins_[i] -= counts[i];
+        sampleNum_ -= counts[i];
+      }
+  }
+
   void Clear()
   {
     for(int i = 0; i < bins_.size(); ++i)
@@ -208,7 +228,6 @@ public:
     readBasicType(is, binSize);
     bins_.resize(binSize);
     prob_.resize(binSize);
-    sampleNum_ = 0;
     for (size_t i = 0; i < binSize; ++i)
       {
         readBasicType(is, bins_[i]);
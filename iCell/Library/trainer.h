@@ -1,19 +1,37 @@
 /**
  * Define trainer class to deal with tree training processing in a depth first way,
- * forest training is just a lot of parallel tree training implemented by openMP.
+ * forest training is just a lot of parallel tree training implemented by openMP
+ * tasks, the large nodes of a tree adding tasks of their own.
  * Randomness is achieved by two ways:
  * randomness in sub-sample input dataset (bagging);
  * randomness in weak learner parameters chosen in each tree node, achieved by
  *   randomly choosing the best combination of weak classifier parameters (outside loop)
  *   and thresholds (inside loop) to get the largest information gain.
+ * Every tree draws from a stream of its own, from the seed of the training
+ * parameters and its index, so a forest is the same for a seed whatever the
+ * number of threads, and a tree trained again is the tree first trained.
+ *
+ * With histogramBins set, axis aligned classifiers are trained on binned
+ * features instead: every feature is cut once into quantile bins, each node
+ * counts the classes of its samples per bin of every feature in one pass, and
+ * every bin boundary of the candidate axes is scored exactly, the threshold
+ * being the boundary value. Only the smaller child is counted again, the
+ * larger takes what remains of its parent, so a node costs
+ * O(samples * features + bins * classes) instead of
+ * O(samples * (candidate classifiers + thresholds)).
  */
 
 #ifndef TRAINER_H
 #define TRAINER_H
 
+#include <algorithm>
 #include <limits>
+#include <numeric>
+#include <stdexcept>
 #include "forest.h"
 #include "trainingcontext.h"
+#include "columnstore.h"
+#include "nodekernels.h"
 
 template<class C, class S, class dataT, class labelT>
 class Trainer
@@ -21,15 +39,17 @@ class Trainer
 public:
   typedef DecisionTree<S,C,dataT> DecisionTreeT;
   typedef DecisionForest<S,C,dataT> DecisionForestT;
+  typedef unsigned short BinT;
 
   Trainer(const MLData<dataT, labelT>& trainingData,
           TrainingParameters trainingParameters,
-          TrainingContext<S, C>& trainingContext,
-          Random& random)
+          TrainingContext<S, C>& trainingContext)
     : trainingData_(trainingData),
+      columns_(trainingData),
       trainingParameters_(trainingParameters),
       trainingContext_(trainingContext),
-      random_(random)
+      taskSampleNum_(4096),
+      simdLevel_(DetectSimdLevel())
   {
     if (trainingParameters_.subSamplePercent == 0.0)
       {
@@ -40,11 +60,126 @@ public:
         subSampleNum_ = trainingData_.Size()
             * trainingParameters_.subSamplePercent / 100;
       }
+    if (trainingParameters_.histogramBins > 0)
+      {
+        if (!IsAxisAligned<C>::value)
+          {
+            throw std::runtime_error("training parameters: histogramBins needs axis aligned classifiers\n");
+          }
+        classNum_ = trainingContext_.Statistics().bins_.size();
+        QuantileBins();
+      }
+  }
+
+  // selects at compile time whether the binned trainer is built for C
+  template<bool axisAligned>
+  struct BinnedTag {};
+
+  // the feature an axis aligned classifier splits, the only classifiers
+  // trained on bins; there is no overload for the others, so the binned
+  // trainer does not compile for them
+  template<class dT, class lT>
+  static int Axis(const AxisAlignedClassifier<dT, lT>& classifier)
+  {
+    return classifier.axis_;
+  }
+
+  // cut every feature into at most histogramBins bins of about as many
+  // samples, from the quantiles of an evenly spaced sketch of the samples,
+  // and keep the bin of every sample. A feature value x falls in bin j when
+  // binEdges_[j-1] <= x < binEdges_[j]; NaN falls in the last bin
+  void QuantileBins()
+  {
+    const size_t sketchNum = 65536;
+    size_t binNum = trainingParameters_.histogramBins;
+    if ((binNum < 2) || (binNum > std::numeric_limits<BinT>::max() + (size_t)1))
+      {
+        throw std::runtime_error("training parameters: histogramBins should be in 2-65536\n");
+      }
+    size_t dataNum = trainingData_.Size();
+    size_t dataDim = trainingData_.Dimension();
+    size_t sampleNum = std::min(dataNum, sketchNum);
+
+    binEdges_.resize(dataDim);
+    binBegin_.resize(dataDim + 1);
+    binBegin_[0] = 0;
+    std::vector<dataT> values;
+    for (index_t f = 0; f < dataDim; ++f)
+      {
+        values.clear();
+        for (index_t i = 0; i < sampleNum; ++i)
+          {
+            dataT x = columns_(i * dataNum / sampleNum, f);
+            if (x == x)
+              {
+                values.push_back(x);
+              }
+          }
+        std::sort(values.begin(), values.end());
+
+        std::vector<dataT>& edges = binEdges_[f];
+        edges.clear();
+        for (index_t j = 1; j < binNum && !values.empty(); ++j)
+          {
+            dataT edge = values[j * values.size() / binNum];
+            if (edge > (edges.empty() ? values[0] : edges.back()))
+              {
+                edges.push_back(edge);
+              }
+          }
+        binBegin_[f + 1] = binBegin_[f] + edges.size() + 1;
+      }
+
+    binCodes_.resize(dataNum * dataDim);
+    for (index_t f = 0; f < dataDim; ++f)
+      {
+        const dataT* column = columns_.Column(f);
+        for (index_t i = 0; i < dataNum; ++i)
+          {
+            binCodes_[i * dataDim + f] = std::upper_bound(binEdges_[f].begin(), binEdges_[f].end(),
+                                                          column[i])
+                                         - binEdges_[f].begin();
+          }
+      }
+  }
+
+  // class counts of the samples indices[begin, end) per bin of every
+  // feature, those of bin b of feature f from (binBegin_[f] + b) * classNum_.
+  // Large nodes count each feature in a concurrent task
+  void BinCounts(std::vector<size_t>& histogram,
+                 const std::vector<sample_t>& indices,
+                 index_t begin, index_t end)
+  {
+    std::fill(histogram.begin(), histogram.end(), 0);
+    size_t dataDim = binEdges_.size();
+    if (end - begin >= taskSampleNum_)
+      {
+        for (index_t f = 0; f < dataDim; ++f)
+          {
+            #pragma omp task default(shared) firstprivate(f)
+            for (index_t i = begin; i < end; ++i)
+              {
+                size_t label = trainingData_.label[indices[i]];
+                ++histogram[(binBegin_[f] + binCodes_[indices[i] * dataDim + f]) * classNum_ + label];
+              }
+          }
+        #pragma omp taskwait
+        return;
+      }
+    for (index_t i = begin; i < end; ++i)
+      {
+        const BinT* codes = &binCodes_[indices[i] * dataDim];
+        size_t label = trainingData_.label[indices[i]];
+        for (index_t f = 0; f < dataDim; ++f)
+          {
+            ++histogram[(binBegin_[f] + codes[f]) * classNum_ + label];
+          }
+      }
   }
 
   size_t CandidateThresholds(std::vector<double>& thresholds,
                              std::vector<double>& featureResponses,
-                             index_t begin, index_t end)
+                             index_t begin, index_t end, Random& random)
   {
     size_t thresholdNum;
     if ((end - begin) > trainingParameters_.candidateClassifierThresholdNum)
@@ -52,7 +187,7 @@ public:
         thresholdNum = trainingParameters_.candidateClassifierThresholdNum;
         for (size_t i = 0; i < (thresholdNum + 1); ++i)
           {
-            thresholds[i] = featureResponses[random_.RandI(begin, end)];
+            thresholds[i] = featureResponses[random.RandI(begin, end)];
           }
       }
     else
@@ -74,30 +209,154 @@ public:
         for (size_t i = 0; i < thresholdNum; ++i)
           {
             thresholds[i] = thresholds[i] +
-                random_.RandD() * (thresholds[i+1] - thresholds[i]);
+                random.RandD() * (thresholds[i+1] - thresholds[i]);
           }
         return thresholdNum;
       }
   }
 
+  // boolean responses of classifier for the samples indices[begin, end), as
+  // Response gives them, from feature responses read a chunk at a time
+  void SplitResponses(const C& classifier, const std::vector<sample_t>& indices,
+                      index_t begin, index_t end,
+                      std::vector<unsigned char>& responses)
+  {
+    const size_t chunk = 256;
+    double featureResponses[chunk];
+    for (index_t j = begin; j < end; j += chunk)
+      {
+        size_t n = std::min<size_t>(chunk, end - j);
+        classifier.FeatureResponses(columns_, &indices[j], n, featureResponses);
+        for (size_t k = 0; k < n; ++k)
+          {
+            responses[j + k] = featureResponses[k] < classifier.threshold_;
+          }
+      }
+  }
+
+  // the statistics and thresholds a DepthFirst call works in, new for every
+  // concurrent task
+  void Scratch(S& pStatistics, S& lStatistics, S& rStatistics,
+               std::vector<S>& ctStatistics,
+               std::vector<double>& cthresholds)
+  {
+    pStatistics = trainingContext_.Statistics();
+    lStatistics = trainingContext_.Statistics();
+    rStatistics = trainingContext_.Statistics();
+
+    ctStatistics.resize(trainingParameters_.candidateClassifierThresholdNum + 1);
+    for(size_t i = 0; i < (trainingParameters_.candidateClassifierThresholdNum + 1); ++i)
+      {
+        ctStatistics[i] = trainingContext_.Statistics();
+      }
+
+    cthresholds.resize(trainingParameters_.candidateClassifierThresholdNum + 1); // only candidateClassifierThresholdNum is valid
+  }
+
+  // information gain of the best candidate threshold of classifier on the
+  // samples indices[begin, end), which becomes its threshold, -infinity
+  // when no threshold splits them. The feature responses are kept from
+  // featureResponses[first]
+  double CandidateIG(C& classifier, S& pStatistics, S& lStatistics, S& rStatistics,
+                     std::vector<S>& ctStatistics,
+                     std::vector<double>& cthresholds,
+                     const std::vector<sample_t>& indices,
+                     index_t begin, index_t end,
+                     std::vector<double>& featureResponses, index_t first,
+                     Random& random)
+  {
+    for (size_t j = 0; j < ctStatistics.size(); ++j)
+      {
+        ctStatistics[j].Clear();
+      }
+
+    classifier.FeatureResponses(columns_, &indices[begin], end - begin, &featureResponses[first]);
+
+    size_t thresholdNum = 0;
+    int counts = 0;
+    while ((thresholdNum == 0) && (end - begin > 1) && (counts < 10))     /////////////
+      {
+        thresholdNum = CandidateThresholds(cthresholds, featureResponses, first, first + end - begin,
+                                           random);
+        counts++;
+      }
+
+    // the thresholds are sorted, the bucket of a response is the number of
+    // them it is not below
+    const size_t chunk = 256;
+    unsigned int buckets[chunk];
+    for (index_t j = begin; j < end; j += chunk)
+      {
+        size_t n = std::min<size_t>(chunk, end - j);
+        BucketResponses(simdLevel_, &featureResponses[first + j - begin], n,
+                        &cthresholds[0], thresholdNum, buckets);
+        for (size_t k = 0; k < n; ++k)
+          {
+            ctStatistics[buckets[k]].Aggregate(trainingData_, indices[j + k]);
+          }
+      }
+
+    double bestIG = -std::numeric_limits<double>::infinity();
+    double cIG = 0.0;
+    for (size_t j = 0; j < thresholdNum; ++j)
+      {
+        lStatistics.Clear();
+        rStatistics.Clear();
+
+        for (size_t k = 0; k < (thresholdNum + 1); ++k)
+          {
+            if (k <= j)
+              {
+                lStatistics.Aggregate(ctStatistics[k]);
+              }
+            else
+              {
+                rStatistics.Aggregate(ctStatistics[k]);
+              }
+          }
+
+        cIG = trainingContext_.ComputeIG(pStatistics, lStatistics, rStatistics,
+                                         trainingParameters_.weights);
+
+        if ((cIG >= 0.0) && (cIG >= bestIG))
+          {
+            bestIG = cIG;
+            classifier.threshold_ = cthresholds[j];
+          }
+      }
+    return bestIG;
+  }
+
+  // Large nodes evaluate their candidate classifiers and train their left
+  // subtree as concurrent tasks, so that the cores are kept busy with fewer
+  // trees than cores. The tasks have their own statistics and thresholds,
+  // and share indices, featureResponses, responses and scratch, of which
+  // each node only touches [begin, end). The node draws from random, and forks a
+  // stream for each candidate and subtree before any task starts, so the
+  // tree is the same whatever the number of threads
   void DepthFirst(DecisionTreeT& tree, Node* pnode,
                   bool side, size_t cDepth,
                   index_t begin, index_t end,
                   S& pStatistics, S& lStatistics, S& rStatistics,
                   std::vector<S>& ctStatistics,
                   std::vector<double>& cthresholds,
-                  std::vector<size_t>& indices,
+                  std::vector<sample_t>& indices,
                   std::vector<double>& featureResponses,
-                  std::vector<bool>& responses)
+                  std::vector<unsigned char>& responses,
+                  std::vector<sample_t>& scratch,
+                  Random& random)
   {
     if (trainingParameters_.treeDepth == 1)
       {
         throw std::runtime_error("training parameters: treeDepth couldn't be 1\n");
       }
-    if (tree.depth_ < cDepth)
-      {
-        tree.depth_ = cDepth;
-      }
+    #pragma omp critical(icell_tree_nodes)
+    {
+      if (tree.depth_ < cDepth)
+        {
+          tree.depth_ = cDepth;
+        }
+    }
     Node* cNode;
     pStatistics.Clear();
     for(index_t i = begin; i < end; ++i)
@@ -115,63 +374,217 @@ public:
           }
       }
 
-    size_t thresholdNum;
+    size_t candidateNum = trainingParameters_.candidateNodeClassifierNum;
+    std::vector<C> cClassifiers(candidateNum);
+    std::vector<Random> cRandoms;
+    std::vector<double> cIGs(candidateNum);
     double bestIG = 0.0;
-    double cIG = 0.0;
-    C bestClassifier = trainingContext_.RandomClassifier(random_);
+    C bestClassifier = trainingContext_.RandomClassifier(random);
     int maxTrial = 3;
     int trial = 0;
     while (trial < maxTrial)
       {
-        for(size_t i = 0; i < trainingParameters_.candidateNodeClassifierNum; ++i)
+        cRandoms.clear();
+        for(size_t i = 0; i < candidateNum; ++i)
           {
-            C cClassifier = trainingContext_.RandomClassifier(random_);
+            cClassifiers[i] = trainingContext_.RandomClassifier(random);
+            cRandoms.push_back(random.Fork());
+          }
 
-            for (size_t j = 0; j < ctStatistics.size(); ++j)
+        if (end - begin >= taskSampleNum_)
+          {
+            // ComputeIG sets the probabilities of the parent statistics
+            std::vector<S> parents(candidateNum, pStatistics);
+            for(size_t i = 0; i < candidateNum; ++i)
               {
-                ctStatistics[j].Clear();
+                #pragma omp task default(shared) firstprivate(i)
+                {
+                  S tStatistics, lStats, rStats;
+                  std::vector<S> ctStats;
+                  std::vector<double> cths;
+                  std::vector<double> tResponses(end - begin);
+                  Scratch(tStatistics, lStats, rStats, ctStats, cths);
+                  cIGs[i] = CandidateIG(cClassifiers[i], parents[i], lStats, rStats, ctStats, cths,
+                                        indices, begin, end, tResponses, 0, cRandoms[i]);
+                }
               }
-
-            for (index_t j = begin; j < end; ++j)
+            #pragma omp taskwait
+            // the tasks set the probabilities of their copies, the leaf
+            // test and the leaves read those of pStatistics
+            pStatistics.Entropy(trainingParameters_.weights);
+          }
+        else
+          {
+            for(size_t i = 0; i < candidateNum; ++i)
               {
-                featureResponses[j] = cClassifier.FeatureResponse(trainingData_, indices[j]);
+                cIGs[i] = CandidateIG(cClassifiers[i], pStatistics, lStatistics, rStatistics,
+                                      ctStatistics, cthresholds, indices, begin, end,
+                                      featureResponses, begin, cRandoms[i]);
               }
+          }
 
-            thresholdNum = 0;
-            int counts = 0;
-            while ((thresholdNum == 0) && (end - begin > 1) && (counts < 10))     /////////////
+        for(size_t i = 0; i < candidateNum; ++i)
+          {
+            if (cIGs[i] >= bestIG)
               {
-                thresholdNum = CandidateThresholds(cthresholds, featureResponses, begin, end);
-                counts++;
+                bestIG = cIGs[i];
+                bestClassifier = cClassifiers[i];
               }
+          }
 
-            size_t which;
-            for (index_t j = begin; j < end; ++j)
+        if (cDepth == 1)
+          {
+            cNode = tree.AddRoot(bestClassifier, pStatistics, bestIG);
+            break;
+          }
+        else
+          {
+            if (bestIG <= trainingParameters_.splitIG)
               {
-                which = 0;
-                while ((which < thresholdNum) &&
-                       (featureResponses[j] >= cthresholds[which]))
+                if ((pStatistics.Entropy() <= trainingParameters_.leafEntropy) ||
+                    (trainingParameters_.leafEntropy == -std::numeric_limits<double>::infinity()))
                   {
-                    ++which;
+                    cNode = tree.AddLeafNode(side, pnode, pStatistics, bestIG);
+                    return;
                   }
-                ctStatistics[which].Aggregate(trainingData_, indices[j]);
+                else
+                  {
+                    ++trial;
+                    if (trial == maxTrial)
+                      {
+                        #pragma omp atomic
+                        ++tree.suspectLeaves_;
+                        cNode = tree.AddLeafNode(side, pnode, pStatistics, bestIG);
+                        return;
+                      }
+                    continue;
+                  }
+              }
+            else
+              {
+                cNode = tree.AddSplitNode(side, pnode, bestClassifier, pStatistics, bestIG);
+                break;
               }
+          }
+      }
+
+    SplitResponses(bestClassifier, indices, begin, end, responses);
+
+    index_t division = Partition(responses, indices, begin, end, scratch);
 
-            for (size_t j = 0; j < thresholdNum; ++j)
+    Random lRandom = random.Fork();
+    Random rRandom = random.Fork();
+    if (division - begin >= taskSampleNum_)
+      {
+        #pragma omp task default(shared) firstprivate(cNode, cDepth, begin, division, lRandom)
+        {
+          S tStatistics, lStats, rStats;
+          std::vector<S> ctStats;
+          std::vector<double> cths;
+          Scratch(tStatistics, lStats, rStats, ctStats, cths);
+          DepthFirst(tree, cNode, true, cDepth + 1, begin, division,
+                     tStatistics, lStats, rStats, ctStats,
+                     cths, indices, featureResponses, responses, scratch, lRandom);
+        }
+      }
+    else
+      {
+        DepthFirst(tree, cNode, true, cDepth + 1, begin, division,
+                   pStatistics, lStatistics, rStatistics, ctStatistics,
+                   cthresholds, indices, featureResponses, responses, scratch, lRandom);
+      }
+    DepthFirst(tree, cNode, false, cDepth + 1, division, end,
+               pStatistics, lStatistics, rStatistics, ctStatistics,
+               cthresholds, indices, featureResponses, responses, scratch, rRandom);
+    #pragma omp taskwait
+  }
+
+  // DepthFirst on binned features, the bin counts of the node in
+  // histograms[slot]. Its smaller child counts into the next slot and the
+  // larger takes this one, which is free once the node is split
+  void DepthFirstBinned(DecisionTreeT& tree, Node* pnode,
+                        bool side, size_t cDepth,
+                        index_t begin, index_t end, index_t slot,
+                        std::vector<std::vector<size_t> >& histograms,
+                        S& pStatistics, S& lStatistics, S& rStatistics,
+                        std::vector<sample_t>& indices,
+                        std::vector<unsigned char>& responses,
+                        std::vector<sample_t>& scratch,
+                        Random& random)
+  {
+    if (trainingParameters_.treeDepth == 1)
+      {
+        throw std::runtime_error("training parameters: treeDepth couldn't be 1\n");
+      }
+    #pragma omp critical(icell_tree_nodes)
+    {
+      if (tree.depth_ < cDepth)
+        {
+          tree.depth_ = cDepth;
+        }
+    }
+    Node* cNode;
+    pStatistics.Clear();
+    if (trainingParameters_.treeDepth > 0)
+      {
+        if (cDepth >= trainingParameters_.treeDepth)
+          {
+            for(index_t i = begin; i < end; ++i)
               {
-                lStatistics.Clear();
-                rStatistics.Clear();
+                pStatistics.Aggregate(trainingData_, indices[i]);
+              }
+            cNode = tree.AddLeafNode(side, pnode, pStatistics,
+                                     -std::numeric_limits<double>::infinity());
+            return;
+          }
+      }
+
+    if (histograms.size() <= slot + 1)
+      {
+        histograms.resize(slot + 2);
+      }
+    if (histograms[slot + 1].empty())
+      {
+        histograms[slot + 1].resize(binBegin_.back() * classNum_);
+      }
+    std::vector<size_t>& histogram = histograms[slot];
+    // the bins of any feature hold all the samples of the node
+    for (index_t b = binBegin_[0]; b < binBegin_[1]; ++b)
+      {
+        pStatistics.Aggregate(&histogram[b * classNum_]);
+      }
 
-                for (size_t k = 0; k < (thresholdNum + 1); ++k)
+    double bestIG = 0.0;
+    double cIG = 0.0;
+    C bestClassifier = trainingContext_.RandomClassifier(random);
+    int maxTrial = 3;
+    int trial = 0;
+    while (trial < maxTrial)
+      {
+        for(size_t i = 0; i < trainingParameters_.candidateNodeClassifierNum; ++i)
+          {
+            C cClassifier = trainingContext_.RandomClassifier(random);
+            int axis = Axis(cClassifier);
+            const std::vector<dataT>& edges = binEdges_[axis];
+
+            // x < edges[j] sends the bins up to j one way, the others the
+            // other way
+            lStatistics.Clear();
+            rStatistics.Clear();
+            rStatistics.Aggregate(pStatistics);
+            for (size_t j = 0; j < edges.size(); ++j)
+              {
+                // a bin without samples splits as the one before
+                const size_t* counts = &histogram[(binBegin_[axis] + j) * classNum_];
+                if (std::accumulate(counts, counts + classNum_, (size_t)0) == 0)
                   {
-                    if (k <= j)
-                      {
-                        lStatistics.Aggregate(ctStatistics[k]);
-                      }
-                    else
-                      {
-                        rStatistics.Aggregate(ctStatistics[k]);
-                      }
+                    continue;
+                  }
+                lStatistics.Aggregate(counts);
+                rStatistics.Subtract(counts);
+                if (rStatistics.sampleNum_ == 0)
+                  {
+                    break;
                   }
 
                 cIG = trainingContext_.ComputeIG(pStatistics, lStatistics, rStatistics,
@@ -181,7 +594,7 @@ public:
                   {
                     bestIG = cIG;
                     bestClassifier = cClassifier;
-                    bestClassifier.threshold_ = cthresholds[j];
+                    bestClassifier.threshold_ = edges[j];
                   }
               }
           }
@@ -206,6 +619,7 @@ public:
                     ++trial;
                     if (trial == maxTrial)
                       {
+                        #pragma omp atomic
                         ++tree.suspectLeaves_;
                         cNode = tree.AddLeafNode(side, pnode, pStatistics, bestIG);
                         return;
@@ -221,22 +635,81 @@ public:
           }
       }
 
-    for (index_t i = begin; i < end; ++i)
+    SplitResponses(bestClassifier, indices, begin, end, responses);
+
+    index_t division = Partition(responses, indices, begin, end, scratch);
+
+    bool smallerLeft = (division - begin) <= (end - division);
+    index_t smallBegin = smallerLeft ? begin : division;
+    index_t smallEnd = smallerLeft ? division : end;
+    index_t largeBegin = smallerLeft ? division : begin;
+    index_t largeEnd = smallerLeft ? end : division;
+    if ((trainingParameters_.treeDepth == 0) || (cDepth + 1 < trainingParameters_.treeDepth))
       {
-        responses[i] = bestClassifier.Response(trainingData_, indices[i]);
+        BinCounts(histograms[slot + 1], indices, smallBegin, smallEnd);
+        for (index_t b = 0; b < histogram.size(); ++b)
+          {
+            histogram[b] -= histograms[slot + 1][b];
+          }
       }
 
-    index_t division = Partition(responses, indices, begin, end);
+    // the left subtree forks first, whichever child is smaller
+    Random lRandom = random.Fork();
+    Random rRandom = random.Fork();
+    Random smallRandom = smallerLeft ? lRandom : rRandom;
+    Random largeRandom = smallerLeft ? rRandom : lRandom;
+    if (smallEnd - smallBegin >= taskSampleNum_)
+      {
+        // a concurrent task trains the smaller subtree on its own counts
+        std::vector<std::vector<size_t> > smallHistograms(1);
+        smallHistograms[0].swap(histograms[slot + 1]);
+        #pragma omp task default(shared) firstprivate(cNode, cDepth, smallerLeft, smallBegin, smallEnd, smallHistograms, smallRandom)
+        {
+          S tStatistics = trainingContext_.Statistics();
+          S lStats = trainingContext_.Statistics();
+          S rStats = trainingContext_.Statistics();
+          DepthFirstBinned(tree, cNode, smallerLeft, cDepth + 1, smallBegin, smallEnd, 0,
+                           smallHistograms, tStatistics, lStats, rStats, indices, responses,
+                           scratch, smallRandom);
+        }
+      }
+    else
+      {
+        DepthFirstBinned(tree, cNode, smallerLeft, cDepth + 1, smallBegin, smallEnd, slot + 1,
+                         histograms, pStatistics, lStatistics, rStatistics, indices, responses,
+                         scratch, smallRandom);
+      }
+    DepthFirstBinned(tree, cNode, !smallerLeft, cDepth + 1, largeBegin, largeEnd, slot,
+                     histograms, pStatistics, lStatistics, rStatistics, indices, responses,
+                     scratch, largeRandom);
+    #pragma omp taskwait
+  }
 
-    DepthFirst(tree, cNode, true, cDepth + 1, begin, division,
-               pStatistics, lStatistics, rStatistics, ctStatistics,
-               cthresholds, indices, featureResponses, responses);
-    DepthFirst(tree, cNode, false, cDepth + 1, division, end,
-               pStatistics, lStatistics, rStatistics, ctStatistics,
-               cthresholds, indices, featureResponses, responses);
+  // train tree from the bins of its samples
+  void TrainingBinned(DecisionTreeT& tree,
+                      S& pStatistics, S& lStatistics, S& rStatistics,
+                      std::vector<sample_t>& indices,
+                      std::vector<unsigned char>& responses,
+                      std::vector<sample_t>& scratch,
+                      Random& random, BinnedTag<true>)
+  {
+    std::vector<std::vector<size_t> > histograms(1, std::vector<size_t>(binBegin_.back() * classNum_));
+    BinCounts(histograms[0], indices, 0, subSampleNum_);
+    DepthFirstBinned(tree, 0, true, 1, 0, subSampleNum_, 0, histograms,
+                     pStatistics, lStatistics, rStatistics, indices, responses,
+                     scratch, random);
+  }
+
+  // never called, the constructor rejects histogramBins for classifiers
+  // that are not axis aligned
+  void TrainingBinned(DecisionTreeT&, S&, S&, S&,
+                      std::vector<sample_t>&, std::vector<unsigned char>&,
+                      std::vector<sample_t>&, Random&, BinnedTag<false>)
+  {
   }
 
-  void Training(DecisionTreeT& tree)
+  // train tree on the stream random
+  void Training(DecisionTreeT& tree, Random& random)
   {
     size_t nodeNumBefore = tree.nodes_.size();
     if (nodeNumBefore != 0)
@@ -251,9 +724,10 @@ public:
     S pStatistics, lStatistics, rStatistics;
     std::vector<S> ctStatistics;
     std::vector<double> cthresholds;
-    std::vector<size_t> indices;
+    std::vector<sample_t> indices;
     std::vector<double> featureResponses;
-    std::vector<bool> responses;
+    std::vector<unsigned char> responses;
+    std::vector<sample_t> scratch;
 
     indices.resize(subSampleNum_);
     if (subSampleNum_ == trainingData_.Size())
@@ -267,28 +741,30 @@ public:
       {
         for(index_t i = 0; i < indices.size(); ++i)
           {
-            indices[i] = random_.RandD(0, trainingData_.Size());
+            indices[i] = random.RandI(0, trainingData_.Size());
           }
       }
 
     featureResponses.resize(subSampleNum_);
     responses.resize(subSampleNum_);
+    scratch.resize(subSampleNum_);
 
-    pStatistics = trainingContext_.Statistics();
-    lStatistics = trainingContext_.Statistics();
-    rStatistics = trainingContext_.Statistics();
+    Scratch(pStatistics, lStatistics, rStatistics, ctStatistics, cthresholds);
 
-    ctStatistics.resize(trainingParameters_.candidateClassifierThresholdNum + 1);
-    for(size_t i = 0; i < (trainingParameters_.candidateClassifierThresholdNum + 1); ++i)
+    if (trainingParameters_.histogramBins > 0)
       {
-        ctStatistics[i] = trainingContext_.Statistics();
+        TrainingBinned(tree, pStatistics, lStatistics, rStatistics, indices, responses,
+                       scratch, random, BinnedTag<IsAxisAligned<C>::value>());
+      }
+    else
+      {
+        DepthFirst(tree, 0, true, 1, 0, subSampleNum_,
+                   pStatistics, lStatistics, rStatistics, ctStatistics,
+                   cthresholds, indices, featureResponses, responses, scratch, random);
       }
 
-    cthresholds.resize(trainingParameters_.candidateClassifierThresholdNum + 1); // only candidateClassifierThresholdNum is valid
-
-    DepthFirst(tree, 0, true, 1, 0, subSampleNum_,
-               pStatistics, lStatistics, rStatistics, ctStatistics,
-               cthresholds, indices, featureResponses, responses);
+    // tasks add the nodes in no set order
+    tree.Renumber();
   }
 
   void Training(DecisionForestT& forest)
@@ -308,18 +784,68 @@ public:
         forest.AddTree();
       }
 
-    #pragma omp parallel for
+    // each tree is a task, and so are the large nodes within it. A tree
+    // draws from the stream of its index
+    #pragma omp parallel
+    #pragma omp single
     for (index_t i = 0; i < trainingParameters_.treeNum; ++i)
       {
-        Training(*(forest.trees_[i]));
+        #pragma omp task
+        {
+          Random random(trainingParameters_.seed, i);
+          Training(*(forest.trees_[i]), random);
+        }
+      }
+  }
+
+  // train again only the trees of forest at indices treeIdx, and keep the
+  // others. An index beyond the end of forest adds trees up to it, all of
+  // them trained
+  void Training(DecisionForestT& forest, const std::vector<index_t>& treeIdx)
+  {
+    std::vector<bool> retrain(forest.trees_.size(), false);
+    for (index_t i = 0; i < treeIdx.size(); ++i)
+      {
+        while (forest.trees_.size() <= treeIdx[i])
+          {
+            forest.AddTree();
+            retrain.push_back(true);
+          }
+        retrain[treeIdx[i]] = true;
+      }
+    std::vector<index_t> trainIdx;
+    for (index_t i = 0; i < retrain.size(); ++i)
+      {
+        if (retrain[i])
+          {
+            trainIdx.push_back(i);
+          }
+      }
+
+    #pragma omp parallel
+    #pragma omp single
+    for (index_t i = 0; i < trainIdx.size(); ++i)
+      {
+        #pragma omp task
+        {
+          Random random(trainingParameters_.seed, trainIdx[i]);
+          Training(*(forest.trees_[trainIdx[i]]), random);
+        }
       }
   }
 
   const MLData<dataT, labelT>& trainingData_;
+  ColumnStore<dataT> columns_;                // the features of trainingData_, a column each
   TrainingParameters trainingParameters_;
   TrainingContext<S, C>& trainingContext_;
   size_t subSampleNum_;
-  Random& random_;
+  size_t taskSampleNum_;                      // nodes of this many samples split into tasks
+  SimdLevel simdLevel_;                       // kernels bucketing the feature responses
+
+  std::vector<std::vector<dataT> > binEdges_; // sorted bin boundaries of each feature
+  std::vector<size_t> binBegin_;              // first histogram bin of each feature
+  std::vector<BinT> binCodes_;                // bin of feature f of sample i at i * dimension + f
+  size_t classNum_;
 };
 
 #endif // TRAINER_H
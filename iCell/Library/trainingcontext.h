@@ -20,6 +20,9 @@ struct TrainingParameters
   double splitIG;
   double leafEntropy;
   bool verbose;
+  size_t histogramBins; // 0 for random thresholds, else the quantile bins per feature
+                        // whose boundaries are all scored (axis aligned classifiers)
+  unsigned int seed;    // tree i draws from the random stream (seed, i)
 };
 
 template<class S, class C>
@@ -0,0 +1,202 @@
+/**
+ * Define kernels that travel a block of samples through one compiled tree.
+ *
+ * The block is stored sample by sample, feature f of sample i being
+ * block[i * stride + f]. The scalar kernel walks one sample at a time; on
+ * x86 the AVX2 and AVX-512 kernels push 8 or 16 samples through the tree in
+ * lockstep, gathering each lane's split axis, threshold and feature value and
+ * comparing them under a mask of the lanes not yet at a leaf. The kernel is
+ * chosen at runtime from what the processor supports.
+ */
+
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include <cstddef>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && !defined(ICELL_NO_SIMD)
+#define ICELL_SIMD_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+enum SimdLevel
+{
+  SimdScalar = 0,
+  SimdAVX2 = 1,
+  SimdAVX512 = 2
+};
+
+inline SimdLevel ProbeSimdLevel()
+{
+#ifdef ICELL_SIMD_X86
+  unsigned int a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    {
+      return SimdScalar;
+    }
+  // AVX and OS support for saving the extended registers
+  if (((c & (1u << 27)) == 0) || ((c & (1u << 28)) == 0))
+    {
+      return SimdScalar;
+    }
+  unsigned int xcr0, xcr0High;
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+  if (((xcr0 & 0x6) != 0x6) || (__get_cpuid_max(0, 0) < 7))
+    {
+      return SimdScalar;
+    }
+  __cpuid_count(7, 0, a, b, c, d);
+  if ((b & (1u << 16)) && ((xcr0 & 0xe6) == 0xe6))
+    {
+      return SimdAVX512;
+    }
+  if (b & (1u << 5))
+    {
+      return SimdAVX2;
+    }
+#endif
+  return SimdScalar;
+}
+
+// widest kernel supported by this processor, probed once
+inline SimdLevel DetectSimdLevel()
+{
+  static const SimdLevel level = ProbeSimdLevel();
+  return level;
+}
+
+template<class dataT>
+inline unsigned int TraverseSample(unsigned int root, const int* axis,
+                                   const dataT* threshold, const unsigned int* child,
+                                   const dataT* x)
+{
+  unsigned int node = root;
+  while (axis[node] >= 0)
+    {
+      node = child[node] + (x[axis[node]] < threshold[node]);
+    }
+  return child[node];
+}
+
+template<class dataT>
+inline void TraverseBlockScalar(unsigned int root, const int* axis,
+                                const dataT* threshold, const unsigned int* child,
+                                const dataT* block, size_t stride, size_t n,
+                                unsigned int* leaves)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      leaves[i] = TraverseSample(root, axis, threshold, child, block + i * stride);
+    }
+}
+
+#ifdef ICELL_SIMD_X86
+__attribute__((target("avx2")))
+inline void TraverseBlockAVX2(unsigned int root, const int* axis,
+                              const float* threshold, const unsigned int* child,
+                              const float* block, size_t stride, size_t n,
+                              unsigned int* leaves)
+{
+  const __m256i minusOne = _mm256_set1_epi32(-1);
+  const __m256i laneOffset = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                                _mm256_set1_epi32((int)stride));
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i rowOffset = _mm256_add_epi32(laneOffset, _mm256_set1_epi32((int)(i * stride)));
+      __m256i node = _mm256_set1_epi32((int)root);
+      __m256i feature = _mm256_i32gather_epi32(axis, node, 4);
+      __m256i active = _mm256_cmpgt_epi32(feature, minusOne);
+      while (!_mm256_testz_si256(active, active))
+        {
+          __m256 mask = _mm256_castsi256_ps(active);
+          __m256i next = _mm256_i32gather_epi32((const int*)child, node, 4);
+          __m256 t = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), threshold,
+                                              node, mask, 4);
+          __m256 x = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), block,
+                                              _mm256_add_epi32(rowOffset, feature), mask, 4);
+          // all ones (-1) where the sample goes to the right child
+          __m256i right = _mm256_castps_si256(_mm256_cmp_ps(x, t, _CMP_LT_OQ));
+          node = _mm256_blendv_epi8(node, _mm256_sub_epi32(next, right), active);
+          feature = _mm256_mask_i32gather_epi32(feature, axis, node, active, 4);
+          active = _mm256_and_si256(active, _mm256_cmpgt_epi32(feature, minusOne));
+        }
+      _mm256_storeu_si256((__m256i*)(leaves + i),
+                          _mm256_i32gather_epi32((const int*)child, node, 4));
+    }
+  TraverseBlockScalar(root, axis, threshold, child, block + i * stride, stride,
+                      n - i, leaves + i);
+}
+
+__attribute__((target("avx512f")))
+inline void TraverseBlockAVX512(unsigned int root, const int* axis,
+                                const float* threshold, const unsigned int* child,
+                                const float* block, size_t stride, size_t n,
+                                unsigned int* leaves)
+{
+  const __m512i minusOne = _mm512_set1_epi32(-1);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i laneOffset = _mm512_mullo_epi32(
+        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+        _mm512_set1_epi32((int)stride));
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+      __m512i rowOffset = _mm512_add_epi32(laneOffset, _mm512_set1_epi32((int)(i * stride)));
+      __m512i node = _mm512_set1_epi32((int)root);
+      __m512i feature = _mm512_mask_i32gather_epi32(minusOne, 0xffff, node, axis, 4);
+      __mmask16 active = _mm512_cmpgt_epi32_mask(feature, minusOne);
+      while (active)
+        {
+          __m512i next = _mm512_mask_i32gather_epi32(node, active, node, child, 4);
+          __m512 t = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), active, node,
+                                              threshold, 4);
+          __m512 x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), active,
+                                              _mm512_add_epi32(rowOffset, feature),
+                                              block, 4);
+          __mmask16 right = _mm512_mask_cmp_ps_mask(active, x, t, _CMP_LT_OQ);
+          node = _mm512_mask_add_epi32(next, right, next, one);
+          feature = _mm512_mask_i32gather_epi32(feature, active, node, axis, 4);
+          active = _mm512_mask_cmpgt_epi32_mask(active, feature, minusOne);
+        }
+      _mm512_storeu_si512((void*)(leaves + i),
+                          _mm512_mask_i32gather_epi32(node, 0xffff, node, child, 4));
+    }
+  TraverseBlockScalar(root, axis, threshold, child, block + i * stride, stride,
+                      n - i, leaves + i);
+}
+#endif
+
+// leaf ids reached by the n samples of block in the tree rooted at root
+template<class dataT>
+inline void TraverseBlock(SimdLevel level, unsigned int root, const int* axis,
+                          const dataT* threshold, const unsigned int* child,
+                          const dataT* block, size_t stride, size_t n,
+                          unsigned int* leaves)
+{
+  TraverseBlockScalar(root, axis, threshold, child, block, stride, n, leaves);
+}
+
+inline void TraverseBlock(SimdLevel level, unsigned int root, const int* axis,
+                          const float* threshold, const unsigned int* child,
+                          const float* block, size_t stride, size_t n,
+                          unsigned int* leaves)
+{
+#ifdef ICELL_SIMD_X86
+  if (level == SimdAVX512)
+    {
+      TraverseBlockAVX512(root, axis, threshold, child, block, stride, n, leaves);
+      return;
+    }
+  if (level == SimdAVX2)
+    {
+      TraverseBlockAVX2(root, axis, threshold, child, block, stride, n, leaves);
+      return;
+    }
+#endif
+  TraverseBlockScalar(root, axis, threshold, child, block, stride, n, leaves);
+}
+
+#endif // TRAVERSAL_H
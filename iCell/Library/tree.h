@@ -4,8 +4,8 @@
  * add node into tree should be done through AddRoot, AddSplitNode or AddLeafNode,
  * streaming and serialization interface are included into DecisionTree class.
  *
- * Partition define as a public function that divides parent node's data into
- * its left and right child node according to pre-calculated boolean response.
+ * Partition, in nodekernels.h, divides parent node's data into its left and
+ * right child node according to pre-calculated boolean response.
  */
 
 #ifndef TREE_H
@@ -17,40 +17,7 @@
 #include <cmath>
 #include "node.h"
 #include "data.h"
-
-// paul: bug, this function needs inlining
-inline std::size_t Partition(std::vector<bool>& response,
-                      std::vector<index_t>& index,
-                      index_t begin,
-                      index_t end)
-{
-  index_t i = begin;
-  index_t j = end-1;
-  index_t tmpIdx;
-  bool tmpResps;
-  while (i != j)
-    {
-      while ((response[i] == false) && (i != j))
-        {
-          ++i;
-        }
-      while ((response[j] == true) && (i != j))
-        {
-          --j;
-        }
-      if (i != j)
-        {
-          tmpIdx = index[i];
-          tmpResps = response[i];
-          index[i] = index[j];
-          response[i] = response[j];
-          index[j] = tmpIdx;
-          response[j] = tmpResps;
-        }
-    }
-
-  return (response[i] == false? i+1 : i);
-}
+#include "nodekernels.h"
 
 template<class S, class C, class dataT>
 class DecisionTree
@@ -78,19 +45,21 @@ public:
         index[i] = i;
       }
 
-    std::vector<bool> response(testingData.Size());
+    std::vector<unsigned char> response(testingData.Size());
+    std::vector<index_t> scratch(testingData.Size());
 
     Travel(nodes_[0], 0, testingData.Size(), testingData, testingResult,
-           index, response);
+           index, response, scratch);
   }
 
-  // Added by Paul. This version of the method takes a preallocated vector
-  // index and a preallocated vector response_vec of the same size as
-  // testingData. It does not do allocation to save on computation time
+  // Added by Paul. This version of the method takes preallocated vectors
+  // index, response and scratch of the same size as testingData. It does
+  // not do allocation to save on computation time
   void ApplyFast(MLData<dataT, S*>& testingData,
                  Vector<S*>& testingResult,
                  std::vector<index_t> &index,
-                 std::vector<bool> &response)
+                 std::vector<unsigned char> &response,
+                 std::vector<index_t> &scratch)
   {
     for (index_t i = 0; i != testingData.Size(); ++i)
       {
@@ -98,13 +67,14 @@ public:
       }
 
     Travel(nodes_[0], 0, testingData.Size(), testingData, testingResult,
-           index, response);
+           index, response, scratch);
   }
 
   // depth first travel
   void Travel(Node* node, index_t begin, index_t end,
               MLData<dataT, S*>& testingData, Vector<S*>& testingResult,
-              std::vector<index_t>& index, std::vector<bool>& response)
+              std::vector<index_t>& index, std::vector<unsigned char>& response,
+              std::vector<index_t>& scratch)
   {
     if (begin == end)
       {
@@ -126,12 +96,30 @@ public:
         response[i] = ((SplitT*)node)->classifier_.Response(testingData, index[i]);
       }
 
-    std::size_t division = Partition(response, index, begin, end);
+    std::size_t division = Partition(response, index, begin, end, scratch);
 
     Travel(((SplitT*)node)->leftChild_, begin, division,
-           testingData, testingResult, index, response);
+           testingData, testingResult, index, response, scratch);
     Travel(((SplitT*)node)->rightChild_, division, end,
-           testingData, testingResult, index, response);
+           testingData, testingResult, index, response, scratch);
+  }
+
+  // travel a single sample from the root down to its leaf
+  S* Leaf(MLData<dataT, S*>& testingData, index_t index)
+  {
+    Node* node = nodes_[0];
+    while (!node->IsLeaf())
+      {
+        if (((SplitT*)node)->classifier_.Response(testingData, index))
+          {
+            node = ((SplitT*)node)->rightChild_;
+          }
+        else
+          {
+            node = ((SplitT*)node)->leftChild_;
+          }
+      }
+    return &(((LeafT*)node)->statistics_);
   }
 
   Node* AddLeafNode(bool side, Node* parent, S& statistics, double gain)
@@ -139,20 +127,24 @@ public:
     Node* cnode = (Node*) new LeafT(statistics);
     cnode->type_ = 'l';
     cnode->parent_ = parent;
-    cnode->idx_ = nodes_.size();
     cnode->parentIdx_ = parent->idx_;
     ((LeafT*)cnode)->informationGain_ = gain;
-    if (side == true)
-      {
-        ((SplitNode*)parent)->leftChild_ = cnode;
-        ((SplitNode*)parent)->leftChildIdx_ = cnode->idx_;
-      }
-    else
-      {
-        ((SplitNode*)parent)->rightChild_ = cnode;
-        ((SplitNode*)parent)->rightChildIdx_ = cnode->idx_;
-      }
-    nodes_.push_back(cnode);
+    // subtrees may be trained by concurrent tasks
+    #pragma omp critical(icell_tree_nodes)
+    {
+      cnode->idx_ = nodes_.size();
+      if (side == true)
+        {
+          ((SplitNode*)parent)->leftChild_ = cnode;
+          ((SplitNode*)parent)->leftChildIdx_ = cnode->idx_;
+        }
+      else
+        {
+          ((SplitNode*)parent)->rightChild_ = cnode;
+          ((SplitNode*)parent)->rightChildIdx_ = cnode->idx_;
+        }
+      nodes_.push_back(cnode);
+    }
     return cnode;
   }
 
@@ -169,20 +161,23 @@ public:
       }
     cnode->type_ = 's';
     cnode->parent_ = parent;
-    cnode->idx_ = nodes_.size();
     cnode->parentIdx_ = parent->idx_;
     ((SplitT*)cnode)->informationGain_ = gain;
-    if (side == true)
-      {
-        ((SplitNode*)parent)->leftChild_ = cnode;
-        ((SplitNode*)parent)->leftChildIdx_ = cnode->idx_;
-      }
-    else
-      {
-        ((SplitNode*)parent)->rightChild_ = cnode;
-        ((SplitNode*)parent)->rightChildIdx_ = cnode->idx_;
-      }
-    nodes_.push_back(cnode);
+    #pragma omp critical(icell_tree_nodes)
+    {
+      cnode->idx_ = nodes_.size();
+      if (side == true)
+        {
+          ((SplitNode*)parent)->leftChild_ = cnode;
+          ((SplitNode*)parent)->leftChildIdx_ = cnode->idx_;
+        }
+      else
+        {
+          ((SplitNode*)parent)->rightChild_ = cnode;
+          ((SplitNode*)parent)->rightChildIdx_ = cnode->idx_;
+        }
+      nodes_.push_back(cnode);
+    }
     return cnode;
   }
 
@@ -206,6 +201,45 @@ public:
     return cnode;
   }
 
+  // number the nodes again depth first, left child first, the order a
+  // serial training adds them in, whatever order concurrent tasks did
+  void Renumber()
+  {
+    if (nodes_.empty())
+      {
+        return;
+      }
+    std::vector<Node*> order;
+    order.reserve(nodes_.size());
+    std::vector<Node*> unvisited(1, nodes_[0]);
+    while (!unvisited.empty())
+      {
+        Node* cNode = unvisited.back();
+        unvisited.pop_back();
+        cNode->idx_ = order.size();
+        order.push_back(cNode);
+        if (!cNode->IsLeaf())
+          {
+            unvisited.push_back(((SplitNode*)cNode)->rightChild_);
+            unvisited.push_back(((SplitNode*)cNode)->leftChild_);
+          }
+      }
+    for (index_t i = 0; i < order.size(); ++i)
+      {
+        Node* cNode = order[i];
+        if (cNode->parent_ != 0)
+          {
+            cNode->parentIdx_ = cNode->parent_->idx_;
+          }
+        if (!cNode->IsLeaf())
+          {
+            ((SplitNode*)cNode)->leftChildIdx_ = ((SplitNode*)cNode)->leftChild_->idx_;
+            ((SplitNode*)cNode)->rightChildIdx_ = ((SplitNode*)cNode)->rightChild_->idx_;
+          }
+      }
+    nodes_.swap(order);
+  }
+
 //  void BreadthFirstTraversal()
 //  {
 //    nodesBreadthFirst_.resize(nodes_.size());
@@ -5,6 +5,15 @@
 #include "itkLaplacianImageFilter.h"
 #include "itkImageAdaptor.h"
 #include "itkRescaleIntensityImageFilter.h"
+#include "itkIntensityWindowingImageFilter.h"
+#include "itkExtractImageFilter.h"
+#include "itkShrinkImageFilter.h"
+#include "itkImageIOFactory.h"
+#include "itkImageIORegion.h"
+#include "itkGaussianOperator.h"
+#include "itksys/SystemTools.hxx"
+#include "itksys/Directory.hxx"
+#include "itkMultiThreader.h"
 #include "itkLaplacianImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
 #include "itkHessianRecursiveGaussianImageFilter.h"
@@ -16,10 +25,22 @@
 #include "Library/classification.h"
 #include "Library/data.h"
 #include "Library/RFapply.h"
+#include "Library/RFquantize.h"
+#include "Library/RFrepredict.h"
+#include "Library/RFmask.h"
+#include "Library/RFcascade.h"
+#include "Library/RFtiff.h"
+#include "Library/RFpiece.h"
 #include "Library/forest.h"
 
 #include "ImageCollectionToImageFilter.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
 
 
 using namespace std;
@@ -57,36 +78,360 @@ public:
     }
 };
 
-int main(int argc, char *argv[])
+typedef itk::Image<itk::RGBPixel<float>, 2> RGBImageType;
+typedef itk::Image<float, 2> ImageType;
+
+// In batch mode the next image is read and the previous labels written by
+// helper threads while the current image is classified
+struct BatchReadJob
 {
+    string fileName;
+    RGBImageType::Pointer image;
+    string error;
+};
 
-    /*
-     *      This method trains an RF classifier and saves
-     *      the forest.dat file for use in classification
-     *
-     *      Requires two input arguments:
-     *         -i   Input Testing Image
-     *         -o   Output Filename
-     *         -f   Input Forest Filename
-     *         -nc  Number of Classes
-     *         -sd  Number of Streaming Divisions
-     *
-                                                          */
+struct BatchWriteJob
+{
+    string fileName;
+    ImageType::Pointer labels;
+    string error;
+};
 
-    cerr << " \n\n\t\tiCell Apply \n\t\tby Hyo Min Lee \n\n" << endl;
+ITK_THREAD_RETURN_TYPE BatchReadImage(void *arg)
+{
+    BatchReadJob *job = static_cast<BatchReadJob *>(
+        static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg)->UserData);
+    try
+    {
+        typedef itk::ImageFileReader<RGBImageType> BatchReaderType;
+        BatchReaderType::Pointer reader = BatchReaderType::New();
+        reader->SetFileName(job->fileName);
+        if (itk::RFtiffImageIO::IsTiledTIFF(job->fileName))
+        {
+            reader->SetImageIO(itk::RFtiffImageIO::New());
+        }
+        reader->Update();
+        job->image = reader->GetOutput();
+        job->image->DisconnectPipeline();
+    }
+    catch (itk::ExceptionObject &error)
+    {
+        job->image = NULL;
+        job->error = error.GetDescription();
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
 
-    // Parse command line arguments
-    string inputFilename = "";
-    string outputFilename = "";
-    string forestFilename = "";
-    unsigned short nClass = 0;
-    unsigned int nStream = 0;
+ITK_THREAD_RETURN_TYPE BatchWriteLabels(void *arg)
+{
+    BatchWriteJob *job = static_cast<BatchWriteJob *>(
+        static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg)->UserData);
+    try
+    {
+        typedef itk::ImageFileWriter<ImageType> BatchWriterType;
+        BatchWriterType::Pointer writer = BatchWriterType::New();
+        writer->SetFileName(job->fileName);
+        writer->SetInput(job->labels);
+        writer->Update();
+    }
+    catch (itk::ExceptionObject &error)
+    {
+        job->error = error.GetDescription();
+    }
+    job->labels = NULL;
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+// In tiled mode the next tile, padded by its halo, is read by a helper
+// thread while the current one is classified
+typedef itk::ExtractImageFilter<RGBImageType, RGBImageType> ExtractType;
+
+struct TileReadJob
+{
+    ExtractType::Pointer extract;
+    RGBImageType::RegionType region;
+    RGBImageType::Pointer tile;
+    string error;
+};
+
+ITK_THREAD_RETURN_TYPE ReadTile(void *arg)
+{
+    TileReadJob *job = static_cast<TileReadJob *>(
+        static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg)->UserData);
+    try
+    {
+        job->extract->SetExtractionRegion(job->region);
+        job->extract->Update();
+        job->tile = job->extract->GetOutput();
+        job->tile->DisconnectPipeline();
+    }
+    catch (itk::ExceptionObject &error)
+    {
+        job->tile = NULL;
+        job->error = error.GetDescription();
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+// Pixels around a pixel its features depend on: the largest radius of
+// the Gaussian and bilateral kernels, as the filters size them, and of the
+// Laplacian and gradient operators. The recursive Gaussian of the Hessian
+// has no finite support, its response is below float precision beyond 8
+// sigma.
+template<class TGauss, class TBilateral, class THessian>
+unsigned int FeatureHalo(const TGauss *gauss, const TBilateral *bilateral, const THessian *hessian,
+                         const itk::ImageBase<2>::SpacingType spacing)
+{
+    unsigned int halo = 1;
+    for (unsigned int d = 0; d < 2; d++)
+    {
+        itk::GaussianOperator<double, 2> gaussOperator;
+        double variance = gauss->GetVariance()[d];
+        if (gauss->GetUseImageSpacing())
+        {
+            variance /= spacing[d] * spacing[d];
+        }
+        gaussOperator.SetDirection(d);
+        gaussOperator.SetVariance(variance);
+        gaussOperator.SetMaximumError(gauss->GetMaximumError()[d]);
+        gaussOperator.SetMaximumKernelWidth(gauss->GetMaximumKernelWidth());
+        gaussOperator.CreateDirectional();
+        halo = std::max<unsigned int>(halo, gaussOperator.GetRadius(d));
+
+        halo = std::max<unsigned int>(halo, ceil(bilateral->GetDomainMu() * bilateral->GetDomainSigma()[d] / spacing[d]));
+        halo = std::max<unsigned int>(halo, ceil(8 * hessian->GetSigma() / spacing[d]));
+    }
+    return halo;
+}
+
+// Pastes a piece of a map into its file, written piece by piece. The piece
+// is given the geometry of reference, the whole image, whatever the image
+// it was computed on: in tiled mode the outputs of RFapply only span the
+// tile and its halo, and ioRegion is relative to the whole image
+template<class TVectorImage>
+void WritePiece(const string fileName, const TVectorImage *map, const itk::ImageBase<2> *reference,
+                const itk::ImageIORegion ioRegion)
+{
+    typename TVectorImage::Pointer piece = TVectorImage::New();
+    piece->CopyInformation(reference);
+    piece->SetNumberOfComponentsPerPixel(map->GetNumberOfComponentsPerPixel());
+    piece->SetBufferedRegion(map->GetBufferedRegion());
+    piece->SetRequestedRegion(map->GetBufferedRegion());
+    piece->SetPixelContainer(const_cast<typename TVectorImage::PixelContainer *>(map->GetPixelContainer()));
+
+    typedef itk::RFpiece<TVectorImage> PieceType;
+    typename PieceType::Pointer pieceSource = PieceType::New();
+    pieceSource->SetPiece(piece);
+    typedef itk::ImageFileWriter<TVectorImage> PieceWriterType;
+    typename PieceWriterType::Pointer pieceWriter = PieceWriterType::New();
+    pieceWriter->SetFileName(fileName);
+    pieceWriter->SetInput(pieceSource->GetOutput());
+    pieceWriter->SetIORegion(ioRegion);
+    pieceWriter->Update();
+}
+
+// Zeros pasted into a map file written piece by piece, for a piece of
+// background that is not classified
+template<class TVectorImage>
+void WriteEmptyPiece(const string fileName, unsigned int nComp, const itk::ImageBase<2> *reference,
+                     const typename TVectorImage::RegionType region, const itk::ImageIORegion ioRegion)
+{
+    typename TVectorImage::Pointer piece = TVectorImage::New();
+    piece->CopyInformation(reference);
+    piece->SetNumberOfComponentsPerPixel(nComp);
+    piece->SetBufferedRegion(region);
+    piece->SetRequestedRegion(region);
+    piece->Allocate();
+    typename TVectorImage::PixelType zero(nComp);
+    zero.Fill(0);
+    piece->FillBuffer(zero);
+    WritePiece<TVectorImage>(fileName, piece, reference, ioRegion);
+}
+
+// The images of a batch: a list file of "input output" lines (# starts a
+// comment), or every readable image of a directory, labelled into
+// outputDirectory as <name>_seg.nii
+bool ListBatch(const string batch, const string outputDirectory,
+               vector<string> &inputs, vector<string> &outputs)
+{
+    if (itksys::SystemTools::FileIsDirectory(batch.c_str()))
+    {
+        itksys::Directory directory;
+        directory.Load(batch.c_str());
+        vector<string> names;
+        for (unsigned long i = 0; i < directory.GetNumberOfFiles(); i++)
+        {
+            string path = batch + "/" + directory.GetFile(i);
+            if (!itksys::SystemTools::FileIsDirectory(path.c_str()) &&
+                itk::ImageIOFactory::CreateImageIO(path.c_str(), itk::ImageIOFactory::ReadMode).IsNotNull())
+            {
+                names.push_back(directory.GetFile(i));
+            }
+        }
+        sort(names.begin(), names.end());
+        for (unsigned int i = 0; i < names.size(); i++)
+        {
+            inputs.push_back(batch + "/" + names[i]);
+            outputs.push_back(outputDirectory + "/" +
+                              itksys::SystemTools::GetFilenameWithoutLastExtension(names[i]) + "_seg.nii");
+        }
+        return true;
+    }
+
+    ifstream list(batch.c_str());
+    if (!list.is_open())
+    {
+        return false;
+    }
+    string line;
+    while (getline(list, line))
+    {
+        istringstream fields(line);
+        string input, output;
+        if (!(fields >> input) || (input[0] == '#'))
+        {
+            continue;
+        }
+        if (!(fields >> output))
+        {
+            return false;
+        }
+        inputs.push_back(input);
+        outputs.push_back(output);
+    }
+    return true;
+}
+
+typedef itk::ImageFileReader<RGBImageType> readerType;
+typedef itk::ImageAdaptor<RGBImageType, RedChannelPixelAccessor> RedAdaptorType;
+typedef itk::ImageAdaptor<RGBImageType, GreenChannelPixelAccessor> GreenAdaptorType;
+typedef itk::ImageAdaptor<RGBImageType, BlueChannelPixelAccessor> BlueAdaptorType;
+typedef itk::ImageFileWriter<ImageType> WriterType;
+
+typedef itk::RFapply<ImageType> applyType;
+typedef applyType::ProbabilityImageType ProbabilityImageType;
+typedef itk::VectorImage<unsigned char, 2> ByteProbabilityImageType;
+typedef itk::RFquantize<ProbabilityImageType, ByteProbabilityImageType> QuantizeType;
+typedef applyType::LeafImageType LeafImageType;
+typedef applyType::VoteSumImageType VoteSumImageType;
+typedef itk::ImageFileReader<VoteSumImageType> VoteSumReaderType;
+typedef applyType::MaskImageType MaskImageType;
+typedef itk::ImageFileReader<MaskImageType> MaskReaderType;
+typedef itk::RFmask<RGBImageType, MaskImageType> MaskFilterType;
+typedef itk::ShrinkImageFilter<RGBImageType, RGBImageType> ShrinkType;
+typedef itk::RFcascade<ImageType, ProbabilityImageType, MaskImageType> CascadeType;
+
+// The command line of icell_apply (see main). The flags tell which of the
+// optional arguments were given.
+struct ApplyOptions
+{
+    string inputFilename;
+    string outputFilename;
+    string batchFilename;
+    string forestFilename;
+    unsigned short nClass;
+    unsigned int nStream;
+    string evaluator;
+    string kernelFilename;
+    bool checkEvaluator;
+    string vote;
+    VoteMode voteMode;
+    double earlyExitMargin;
+    unsigned int tileSize;
+    unsigned int halo;
+    string probabilityFilename;
+    string probabilityType;
+    string leafFilename;
+    string cachedLeafFilename;
+    string voteSumFilename;
+    string cachedVoteSumFilename;
+    string previousForestFilename;
+    string maskFilename;
+    double maskThreshold;
+    int backgroundLabel;
+    string coarseForestFilename;
+    unsigned int coarseShrink;
+    unsigned int coarseRadius;
+    double coarseConfidence;
+    unsigned int nThread;
+    vector<string> batchInputs;
+    vector<string> batchOutputs;
+
+    bool batch;                 // -b
+    bool predictLeaves;         // -rl
+    bool updateVoteSums;        // -pvs
+    bool earlyExit;             // -ee
+    bool tiled;                 // -tile, a masked image or a tiled TIFF
+    bool haloGiven;             // -halo
+    bool probabilityMap;        // -p
+    bool leafMap;               // -l
+    bool voteSumMap;            // -vs
+    bool maskFile;              // -m
+    bool maskByThreshold;       // -mt
+    bool masked;                // -m, -mt or -cf
+    bool cascade;               // -cf
+    bool threadsGiven;          // -nt
+};
+
+// Parses and verifies the command line, false on an error it has reported
+bool ParseOptions(int argc, char *argv[], ApplyOptions &options)
+{
+    options.inputFilename = "";
+    options.outputFilename = "";
+    options.batchFilename = "";
+    options.forestFilename = "";
+    options.nClass = 0;
+    options.nStream = 0;
+    options.evaluator = "tree";
+    options.kernelFilename = "";
+    options.checkEvaluator = false;
+    options.vote = "exact";
+    options.earlyExitMargin = 0;
+    options.tileSize = 0;
+    options.halo = 0;
+    options.probabilityFilename = "";
+    options.probabilityType = "float";
+    options.leafFilename = "";
+    options.cachedLeafFilename = "";
+    options.voteSumFilename = "";
+    options.cachedVoteSumFilename = "";
+    options.previousForestFilename = "";
+    options.maskFilename = "";
+    options.maskThreshold = 0;
+    options.backgroundLabel = 0;
+    options.coarseForestFilename = "";
+    options.coarseShrink = 4;
+    options.coarseRadius = 1;
+    options.coarseConfidence = 0.6;
+    options.nThread = 0;
 
     bool inputFilename_ = true;
     bool outputFilename_ = true;
+    bool batchFilename_ = true;
     bool forestFilename_ = true;
     bool nClass_ = true;
     bool nStream_ = true;
+    bool evaluator_ = true;
+    bool kernelFilename_ = true;
+    bool vote_ = true;
+    bool earlyExit_ = true;
+    bool tileSize_ = true;
+    bool halo_ = true;
+    bool probabilityFilename_ = true;
+    bool probabilityType_ = true;
+    bool leafFilename_ = true;
+    bool cachedLeafFilename_ = true;
+    bool voteSumFilename_ = true;
+    bool cachedVoteSumFilename_ = true;
+    bool previousForestFilename_ = true;
+    bool maskFilename_ = true;
+    bool maskThreshold_ = true;
+    bool backgroundLabel_ = true;
+    bool coarseForestFilename_ = true;
+    bool coarseShrink_ = true;
+    bool coarseRadius_ = true;
+    bool coarseConfidence_ = true;
+    bool nThread_ = true;
 
     for (unsigned int i = 0; i < argc; i++)
     {
@@ -94,257 +439,1717 @@ int main(int argc, char *argv[])
         {
             if (inputFilename_)
             {
-                inputFilename = argv[i+1];
+                options.inputFilename = argv[i+1];
                 i++;
                 inputFilename_ = false;
             }
             else
             {
                 cerr << "ERROR: Cannot have multiple input images!" << endl;
-                return EXIT_FAILURE;
+                return false;
             }
         }
         else if (strcmp(argv[i], "-o") == 0)
         {
             if (outputFilename_)
             {
-                outputFilename = argv[i+1];
+                options.outputFilename = argv[i+1];
                 i++;
                 outputFilename_ = false;
             }
             else
             {
                 cerr << "ERROR: Cannot have multiple segmentation images!" << endl;
-                return EXIT_FAILURE;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            if (batchFilename_)
+            {
+                options.batchFilename = argv[i+1];
+                i++;
+                batchFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple batches!" << endl;
+                return false;
             }
         }
         else if (strcmp(argv[i], "-f") == 0)
         {
             if (forestFilename_)
             {
-                forestFilename = argv[i+1];
+                options.forestFilename = argv[i+1];
                 i++;
                 forestFilename_ = false;
             }
             else
             {
                 cerr << "ERROR: Cannot have multiple forest files!" << endl;
-                return EXIT_FAILURE;
+                return false;
             }
         }
         else if (strcmp(argv[i], "-nc") == 0)
         {
             if (nClass_)
             {
-                nClass = stoi(argv[i+1]);
+                options.nClass = stoi(argv[i+1]);
                 i++;
                 nClass_ = false;
             }
             else
             {
                 cerr << "ERROR: Cannot set # of classes multiple times!" << endl;
-                return EXIT_FAILURE;
+                return false;
             }
         }
         else if (strcmp(argv[i], "-sd") == 0)
         {
             if (nStream_)
             {
-                nStream = stoi(argv[i+1]);
+                options.nStream = stoi(argv[i+1]);
                 i++;
                 nStream_ = false;
             }
             else
             {
                 cerr << "ERROR: Cannot set # of streaming divisions multiple times!" << endl;
-                return EXIT_FAILURE;
+                return false;
             }
         }
-    }
-
-    // Verify command line arguments
-    if (argc < 2)
-    {
-        cerr << "Usage: " << endl;
-        cerr << argv[0] << " inputImageFile" << endl;
-        return EXIT_FAILURE;
-    }
-    if (inputFilename_)
-    {
-        cerr << "ERROR: No input image specified!" << endl;
-        return EXIT_FAILURE;
-    }
-    if (outputFilename_)
-    {
-        cerr << "ERROR: No segmentation image specified!" << endl;
-        return EXIT_FAILURE;
-    }
-    if (forestFilename_)
-    {
-        cerr << "ERROR: No forest file specified!" << endl;
-        return EXIT_FAILURE;
-    }
-    if (nClass_)
-    {
-        cerr << "ERROR: Number of classes should be specified!" << endl;
-        return EXIT_FAILURE;
-    }
-    if (nStream_)
-    {
-        cerr << "Number of streaming division is not specified. \nProceeding with default value of 1." << endl;
-        nStream = 1;
-    }
-
-    // Display the input parameters for verification
-    cerr << "\nInput image: " << inputFilename << endl;
-    cerr << "Output image: " << outputFilename << endl;
-    cerr << "Forest filename: " << forestFilename << endl;
-    cerr << "# of classes: " << nClass << endl;
-    cerr << "# of stream divisions: " << nStream  << "\n" << endl;
-
-    // Basic Parameter
-    unsigned short nComp = 15;
-
-    // Read input image
-    typedef itk::RGBPixel<float> PixelType; // rgb
-    typedef itk::Image<PixelType, 2> RGBImageType; // image type
-    typedef itk::ImageFileReader<RGBImageType> readerType; // file reader type
-    readerType::Pointer reader = readerType::New(); // reader object
-    reader->SetFileName(inputFilename.c_str());
-
-    // Separate the RGB image
-    typedef itk::ImageAdaptor<RGBImageType, RedChannelPixelAccessor> RedAdaptorType;
-    typedef itk::ImageAdaptor<RGBImageType, GreenChannelPixelAccessor> GreenAdaptorType;
-    typedef itk::ImageAdaptor<RGBImageType, BlueChannelPixelAccessor> BlueAdaptorType;
-
-    RedAdaptorType::Pointer redAdaptor = RedAdaptorType::New();
-    GreenAdaptorType::Pointer greenAdaptor = GreenAdaptorType::New();
-    BlueAdaptorType::Pointer blueAdaptor = BlueAdaptorType::New();
-
-    redAdaptor->SetImage(reader->GetOutput());
-    greenAdaptor->SetImage(reader->GetOutput());
-    blueAdaptor->SetImage(reader->GetOutput());
-
-    typedef itk::Image<float,2> ImageType;
-
-    typedef itk::RescaleIntensityImageFilter<RedAdaptorType, ImageType> RedRescalerType;
-    typedef itk::RescaleIntensityImageFilter<GreenAdaptorType, ImageType> GreenRescalerType;
-    typedef itk::RescaleIntensityImageFilter<BlueAdaptorType, ImageType> BlueRescalerType;
-
-    RedRescalerType::Pointer redRescaler = RedRescalerType::New();
-    GreenRescalerType::Pointer greenRescaler = GreenRescalerType::New();
-    BlueRescalerType::Pointer blueRescaler = BlueRescalerType::New();
-
-    redRescaler->SetInput(redAdaptor);
-    greenRescaler->SetInput(greenAdaptor);
-    blueRescaler->SetInput(blueAdaptor);
-
-    redRescaler->SetOutputMinimum(0);
-    redRescaler->SetOutputMaximum(255);
-    greenRescaler->SetOutputMinimum(0);
-    greenRescaler->SetOutputMaximum(255);
-    blueRescaler->SetOutputMinimum(0);
-    blueRescaler->SetOutputMaximum(255);
-
-
-    // ================   FEATURE GENERATION   ================
-    // Gaussian Image Filter
-    typedef itk::DiscreteGaussianImageFilter<ImageType,ImageType> gaussType;
-    gaussType::Pointer gaussFilter1 = gaussType::New();
-    gaussType::Pointer gaussFilter2 = gaussType::New();
-    gaussType::Pointer gaussFilter3 = gaussType::New();
-    gaussFilter1->SetInput(redRescaler->GetOutput());
-    gaussFilter1->SetVariance(2.56);
-    gaussFilter2->SetInput(greenRescaler->GetOutput());
-    gaussFilter2->SetVariance(2.56);
-    gaussFilter3->SetInput(blueRescaler->GetOutput());
-    gaussFilter3->SetVariance(2.56);
-
-    // BL Filter
-    typedef itk::BilateralImageFilter<ImageType,ImageType> bilateralType;
-    bilateralType::Pointer bilateralFilter1 = bilateralType::New();
-    bilateralType::Pointer bilateralFilter2 = bilateralType::New();
-    bilateralType::Pointer bilateralFilter3 = bilateralType::New();
-    bilateralFilter1->SetInput(redRescaler->GetOutput());
-    bilateralFilter2->SetInput(greenRescaler->GetOutput());
-    bilateralFilter3->SetInput(blueRescaler->GetOutput());
-
-    // Laplacian Filter
-    typedef itk::LaplacianImageFilter<ImageType,ImageType> laplacianType;
-    laplacianType::Pointer laplacianFilter1 = laplacianType::New();
-    laplacianType::Pointer laplacianFilter2 = laplacianType::New();
-    laplacianType::Pointer laplacianFilter3 = laplacianType::New();
-    laplacianFilter1->SetInput(redRescaler->GetOutput());
-    laplacianFilter2->SetInput(greenRescaler->GetOutput());
-    laplacianFilter3->SetInput(blueRescaler->GetOutput());
-
-    // Gradient Magnitude Filter
-    typedef itk::GradientMagnitudeImageFilter<ImageType,ImageType> gradmagType;
-    gradmagType::Pointer gradmagFilter1 = gradmagType::New();
-    gradmagType::Pointer gradmagFilter2 = gradmagType::New();
-    gradmagType::Pointer gradmagFilter3 = gradmagType::New();
-    gradmagFilter1->SetInput(redRescaler->GetOutput());
-    gradmagFilter2->SetInput(greenRescaler->GetOutput());
-    gradmagFilter3->SetInput(blueRescaler->GetOutput());
-
-    // Hessian Filter
-    typedef itk::HessianRecursiveGaussianImageFilter<ImageType,ImageType> hessType;
-    hessType::Pointer hessFilter1 = hessType::New();
-    hessType::Pointer hessFilter2 = hessType::New();
-    hessType::Pointer hessFilter3 = hessType::New();
-    hessFilter1->SetInput(redRescaler->GetOutput());
-    hessFilter2->SetInput(greenRescaler->GetOutput());
-    hessFilter3->SetInput(blueRescaler->GetOutput());
-
-    cerr << "Preprocessing Has Started..." << endl;
-
-     // ================   APPLYING CLASSIFICATION   ================
-
-    ImageType::Pointer Input[15] = {
-                                    gaussFilter1->GetOutput(),
-                                    gaussFilter2->GetOutput(),
-                                    gaussFilter3->GetOutput(),
-                                    bilateralFilter1->GetOutput(),
-                                    bilateralFilter2->GetOutput(),
-                                    bilateralFilter3->GetOutput(),
-                                    laplacianFilter1->GetOutput(),
-                                    laplacianFilter2->GetOutput(),
-                                    laplacianFilter3->GetOutput(),
-                                    gradmagFilter1->GetOutput(),
-                                    gradmagFilter2->GetOutput(),
-                                    gradmagFilter3->GetOutput(),
-                                    hessFilter1->GetOutput(),
-                                    hessFilter2->GetOutput(),
-                                    hessFilter3->GetOutput()
-                                   };
-
-    // Declare and instantiate the RF sampling filter
-    typedef itk::RFapply<ImageType> applyType;
-    applyType::Pointer apply = applyType::New();
-    apply->SetNComp(nComp);
-    apply->SetNClass(nClass);
-    apply->SetForestFileName(forestFilename);
-    for (int i = 0; i < nComp; i++)
-    {
-        apply->SetInputImage(Input[i]);
-    }
-    apply->SetDummyImage(redRescaler->GetOutput());
-
-    // Streaming
-    typedef itk::StreamingImageFilter<ImageType, ImageType> StreamingFilterType;
-    StreamingFilterType::Pointer streamingFilter = StreamingFilterType::New();
-    streamingFilter->SetInput(apply->GetOutput());
-    streamingFilter->SetNumberOfStreamDivisions(nStream);
-
-    // Save the results to a .nii file
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName(outputFilename);
-    writer->SetInput(streamingFilter->GetOutput());
-    writer->SetNumberOfStreamDivisions(nStream);
-    writer->Update();
+        else if (strcmp(argv[i], "-e") == 0)
+        {
+            if (evaluator_)
+            {
+                options.evaluator = argv[i+1];
+                i++;
+                evaluator_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the forest evaluator multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-k") == 0)
+        {
+            if (kernelFilename_)
+            {
+                options.kernelFilename = argv[i+1];
+                i++;
+                kernelFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple kernel files!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-check") == 0)
+        {
+            options.checkEvaluator = true;
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            if (vote_)
+            {
+                options.vote = argv[i+1];
+                i++;
+                vote_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the leaf votes multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-ee") == 0)
+        {
+            if (earlyExit_)
+            {
+                options.earlyExitMargin = stod(argv[i+1]);
+                i++;
+                earlyExit_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the early exit margin multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-tile") == 0)
+        {
+            if (tileSize_)
+            {
+                options.tileSize = stoi(argv[i+1]);
+                i++;
+                tileSize_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the tile size multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-halo") == 0)
+        {
+            if (halo_)
+            {
+                options.halo = stoi(argv[i+1]);
+                i++;
+                halo_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the tile halo multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            if (probabilityFilename_)
+            {
+                options.probabilityFilename = argv[i+1];
+                i++;
+                probabilityFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple probability maps!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-pt") == 0)
+        {
+            if (probabilityType_)
+            {
+                options.probabilityType = argv[i+1];
+                i++;
+                probabilityType_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the probability map type multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-l") == 0)
+        {
+            if (leafFilename_)
+            {
+                options.leafFilename = argv[i+1];
+                i++;
+                leafFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple leaf index maps!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-rl") == 0)
+        {
+            if (cachedLeafFilename_)
+            {
+                options.cachedLeafFilename = argv[i+1];
+                i++;
+                cachedLeafFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot predict from multiple leaf index maps!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-vs") == 0)
+        {
+            if (voteSumFilename_)
+            {
+                options.voteSumFilename = argv[i+1];
+                i++;
+                voteSumFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple vote sum maps!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-pvs") == 0)
+        {
+            if (cachedVoteSumFilename_)
+            {
+                options.cachedVoteSumFilename = argv[i+1];
+                i++;
+                cachedVoteSumFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot update multiple vote sum maps!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-pf") == 0)
+        {
+            if (previousForestFilename_)
+            {
+                options.previousForestFilename = argv[i+1];
+                i++;
+                previousForestFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple previous forest files!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            if (maskFilename_)
+            {
+                options.maskFilename = argv[i+1];
+                i++;
+                maskFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple masks!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-mt") == 0)
+        {
+            if (maskThreshold_)
+            {
+                options.maskThreshold = stod(argv[i+1]);
+                i++;
+                maskThreshold_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the foreground threshold multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-bl") == 0)
+        {
+            if (backgroundLabel_)
+            {
+                options.backgroundLabel = stoi(argv[i+1]);
+                i++;
+                backgroundLabel_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the background label multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-cf") == 0)
+        {
+            if (coarseForestFilename_)
+            {
+                options.coarseForestFilename = argv[i+1];
+                i++;
+                coarseForestFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple coarse forest files!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-cs") == 0)
+        {
+            if (coarseShrink_)
+            {
+                options.coarseShrink = stoi(argv[i+1]);
+                i++;
+                coarseShrink_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the coarse shrink factor multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-cr") == 0)
+        {
+            if (coarseRadius_)
+            {
+                options.coarseRadius = stoi(argv[i+1]);
+                i++;
+                coarseRadius_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the coarse boundary radius multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-cc") == 0)
+        {
+            if (coarseConfidence_)
+            {
+                options.coarseConfidence = stod(argv[i+1]);
+                i++;
+                coarseConfidence_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the coarse confidence multiple times!" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-nt") == 0)
+        {
+            if (nThread_)
+            {
+                options.nThread = stoi(argv[i+1]);
+                i++;
+                nThread_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set # of threads multiple times!" << endl;
+                return false;
+            }
+        }
+    }
+
+    // Verify command line arguments
+    if (argc < 2)
+    {
+        cerr << "Usage: " << endl;
+        cerr << argv[0] << " inputImageFile" << endl;
+        return false;
+    }
+    if (inputFilename_ && batchFilename_ && cachedLeafFilename_)
+    {
+        cerr << "ERROR: No input image specified!" << endl;
+        return false;
+    }
+    if ((!inputFilename_ + !batchFilename_ + !cachedLeafFilename_) > 1)
+    {
+        cerr << "ERROR: Cannot have more than one of an input image, a batch and a leaf index map!" << endl;
+        return false;
+    }
+    if (outputFilename_ && batchFilename_)
+    {
+        cerr << "ERROR: No segmentation image specified!" << endl;
+        return false;
+    }
+    if (!batchFilename_ && (!tileSize_ || !probabilityFilename_ || !leafFilename_
+                            || !voteSumFilename_ || !cachedVoteSumFilename_))
+    {
+        cerr << "ERROR: A batch cannot be classified by tiles or with probability, leaf index or vote sum maps!" << endl;
+        return false;
+    }
+    if (!cachedLeafFilename_ && ((options.evaluator != "tree") || !earlyExit_
+                                 || !tileSize_ || !leafFilename_ || !voteSumFilename_
+                                 || !cachedVoteSumFilename_ || !maskFilename_ || !maskThreshold_))
+    {
+        cerr << "ERROR: Predicting from a leaf index map takes no evaluator, early exit, tiles or leaf index map!" << endl;
+        return false;
+    }
+    if (!leafFilename_ && !earlyExit_)
+    {
+        cerr << "ERROR: Leaf index maps cannot be kept with early exit!" << endl;
+        return false;
+    }
+    if (!leafFilename_ && (!maskFilename_ || !maskThreshold_))
+    {
+        // The pixels out of the mask reach no leaf, and predicting from
+        // the map would give them the class of a leaf
+        cerr << "ERROR: Leaf index maps cannot be kept with a mask or a foreground threshold!" << endl;
+        return false;
+    }
+    if (!voteSumFilename_ && !earlyExit_)
+    {
+        cerr << "ERROR: Vote sum maps cannot be kept with early exit!" << endl;
+        return false;
+    }
+    if (cachedVoteSumFilename_ != previousForestFilename_)
+    {
+        cerr << "ERROR: A vote sum map to update needs the forest that gave it, and only it!" << endl;
+        return false;
+    }
+    if (!cachedVoteSumFilename_ && ((options.evaluator != "tree") || !earlyExit_ || !leafFilename_))
+    {
+        cerr << "ERROR: Updating a vote sum map takes no evaluator, early exit or leaf index map!" << endl;
+        return false;
+    }
+    options.masked = !maskFilename_ || !maskThreshold_;
+    if (!maskFilename_ && !maskThreshold_)
+    {
+        cerr << "ERROR: Cannot have both a mask and a foreground threshold!" << endl;
+        return false;
+    }
+    if (!maskFilename_ && !batchFilename_)
+    {
+        cerr << "ERROR: A batch can only be masked by a foreground threshold!" << endl;
+        return false;
+    }
+    if (options.masked && !cachedVoteSumFilename_)
+    {
+        cerr << "ERROR: A vote sum map is updated on every pixel, without a mask!" << endl;
+        return false;
+    }
+    if (!backgroundLabel_ && !options.masked)
+    {
+        cerr << "ERROR: A background label needs a mask or a foreground threshold!" << endl;
+        return false;
+    }
+    options.cascade = !coarseForestFilename_;
+    if (coarseForestFilename_ && (!coarseShrink_ || !coarseRadius_ || !coarseConfidence_))
+    {
+        cerr << "ERROR: The coarse shrink factor, boundary radius and confidence need a coarse forest!" << endl;
+        return false;
+    }
+    if (options.cascade && (!batchFilename_ || options.masked || !leafFilename_ || !cachedLeafFilename_
+                            || !voteSumFilename_ || !cachedVoteSumFilename_ || (options.evaluator == "kernel")))
+    {
+        cerr << "ERROR: A coarse forest takes no batch, mask, leaf index or vote sum map, or kernel evaluator!" << endl;
+        return false;
+    }
+    if (options.cascade && (options.coarseShrink < 2))
+    {
+        cerr << "ERROR: Coarse shrink factor should be at least 2!" << endl;
+        return false;
+    }
+    if (options.cascade && ((options.coarseConfidence < 0) || (options.coarseConfidence > 1)))
+    {
+        cerr << "ERROR: Coarse confidence should be between 0 and 1!" << endl;
+        return false;
+    }
+    // The full resolution pass only classifies the mask of the pixels to
+    // refine, the others fall back to the coarse predictions
+    options.masked = options.masked || options.cascade;
+    if (options.masked && batchFilename_ && tileSize_)
+    {
+        // The features are only computed on the tiles with foreground
+        options.tileSize = 512;
+        tileSize_ = false;
+    }
+    if (!cachedVoteSumFilename_ && !voteSumFilename_ && (options.cachedVoteSumFilename == options.voteSumFilename))
+    {
+        cerr << "ERROR: The updated vote sum map cannot replace the one it is read from!" << endl;
+        return false;
+    }
+    if (!batchFilename_)
+    {
+        if (itksys::SystemTools::FileIsDirectory(options.batchFilename.c_str()))
+        {
+            if (outputFilename_)
+            {
+                cerr << "ERROR: A batch directory needs an output directory!" << endl;
+                return false;
+            }
+            itksys::SystemTools::MakeDirectory(options.outputFilename.c_str());
+        }
+        if (!ListBatch(options.batchFilename, options.outputFilename, options.batchInputs, options.batchOutputs))
+        {
+            cerr << "ERROR: Cannot read the batch " << options.batchFilename << "!" << endl;
+            return false;
+        }
+        if (options.batchInputs.empty())
+        {
+            cerr << "ERROR: The batch " << options.batchFilename << " has no images!" << endl;
+            return false;
+        }
+    }
+    if (forestFilename_)
+    {
+        cerr << "ERROR: No forest file specified!" << endl;
+        return false;
+    }
+    if (nClass_)
+    {
+        cerr << "ERROR: Number of classes should be specified!" << endl;
+        return false;
+    }
+    if (nStream_)
+    {
+        cerr << "Number of streaming division is not specified. \nProceeding with default value of 1." << endl;
+        options.nStream = 1;
+    }
+    if ((options.evaluator != "tree") && (options.evaluator != "qs") && (options.evaluator != "kernel"))
+    {
+        cerr << "ERROR: Forest evaluator should be tree, qs or kernel!" << endl;
+        return false;
+    }
+    if ((options.evaluator == "kernel") == kernelFilename_)
+    {
+        cerr << "ERROR: The kernel evaluator needs a kernel file, and only it!" << endl;
+        return false;
+    }
+    if ((options.vote != "exact") && (options.vote != "fixed16") && (options.vote != "fixed8") && (options.vote != "hard"))
+    {
+        cerr << "ERROR: Leaf votes should be exact, fixed16, fixed8 or hard!" << endl;
+        return false;
+    }
+    if (!earlyExit_ && ((options.evaluator != "tree") || (options.vote != "exact")))
+    {
+        cerr << "ERROR: Early exit needs the tree evaluator and exact leaf votes!" << endl;
+        return false;
+    }
+    if (options.earlyExitMargin < 0)
+    {
+        cerr << "ERROR: Early exit margin cannot be negative!" << endl;
+        return false;
+    }
+    if (!tileSize_ && (options.tileSize == 0))
+    {
+        cerr << "ERROR: Tile size should be positive!" << endl;
+        return false;
+    }
+    if ((options.probabilityType != "float") && (options.probabilityType != "uchar"))
+    {
+        cerr << "ERROR: Probability map type should be float or uchar!" << endl;
+        return false;
+    }
+    if (!probabilityFilename_)
+    {
+        // The map is written strip by strip, pasted into the file
+        itk::ImageIOBase::Pointer probabilityIO =
+            itk::ImageIOFactory::CreateImageIO(options.probabilityFilename.c_str(), itk::ImageIOFactory::WriteMode);
+        if (probabilityIO.IsNull() || !probabilityIO->CanStreamWrite())
+        {
+            cerr << "ERROR: The probability map format cannot be written in pieces, use .mha!" << endl;
+            return false;
+        }
+    }
+    if (!leafFilename_)
+    {
+        // Written in pieces as the probability map
+        itk::ImageIOBase::Pointer leafIO =
+            itk::ImageIOFactory::CreateImageIO(options.leafFilename.c_str(), itk::ImageIOFactory::WriteMode);
+        if (leafIO.IsNull() || !leafIO->CanStreamWrite())
+        {
+            cerr << "ERROR: The leaf index map format cannot be written in pieces, use .mha!" << endl;
+            return false;
+        }
+    }
+    if (!voteSumFilename_)
+    {
+        // Written in pieces as the probability map
+        itk::ImageIOBase::Pointer voteSumIO =
+            itk::ImageIOFactory::CreateImageIO(options.voteSumFilename.c_str(), itk::ImageIOFactory::WriteMode);
+        if (voteSumIO.IsNull() || !voteSumIO->CanStreamWrite())
+        {
+            cerr << "ERROR: The vote sum map format cannot be written in pieces, use .mha!" << endl;
+            return false;
+        }
+    }
+    if (!inputFilename_ && itk::RFtiffImageIO::IsTiledTIFF(options.inputFilename))
+    {
+        // A slide is labelled tile by tile, its segmentation is never held
+        // whole in memory
+        itk::ImageIOBase::Pointer labelIO =
+            itk::ImageIOFactory::CreateImageIO(options.outputFilename.c_str(), itk::ImageIOFactory::WriteMode);
+        if (labelIO.IsNull() || !labelIO->CanStreamWrite())
+        {
+            cerr << "ERROR: A tiled TIFF is labelled piece by piece, the segmentation format cannot be written in pieces, use .mha!" << endl;
+            return false;
+        }
+    }
+
+    options.batch = !batchFilename_;
+    options.predictLeaves = !cachedLeafFilename_;
+    options.updateVoteSums = !cachedVoteSumFilename_;
+    options.earlyExit = !earlyExit_;
+    options.tiled = !tileSize_;
+    options.haloGiven = !halo_;
+    options.probabilityMap = !probabilityFilename_;
+    options.leafMap = !leafFilename_;
+    options.voteSumMap = !voteSumFilename_;
+    options.maskFile = !maskFilename_;
+    options.maskByThreshold = !maskThreshold_;
+    options.threadsGiven = !nThread_;
+    options.voteMode = ExactVote;
+    if (options.vote == "fixed16")
+    {
+        options.voteMode = Fixed16Vote;
+    }
+    else if (options.vote == "fixed8")
+    {
+        options.voteMode = Fixed8Vote;
+    }
+    else if (options.vote == "hard")
+    {
+        options.voteMode = HardVote;
+    }
+    return true;
+}
+
+// Displays the input parameters for verification
+void PrintOptions(const ApplyOptions &options)
+{
+    if (options.predictLeaves)
+    {
+        cerr << "\nLeaf index map: " << options.cachedLeafFilename << endl;
+        cerr << "Output image: " << options.outputFilename << endl;
+    }
+    else if (!options.batch)
+    {
+        cerr << "\nInput image: " << options.inputFilename << endl;
+        cerr << "Output image: " << options.outputFilename << endl;
+    }
+    else
+    {
+        cerr << "\nBatch: " << options.batchFilename << " (" << options.batchInputs.size() << " images)" << endl;
+    }
+    cerr << "Forest filename: " << options.forestFilename << endl;
+    cerr << "# of classes: " << options.nClass << endl;
+    cerr << "# of stream divisions: " << options.nStream << endl;
+    cerr << "Forest evaluator: " << options.evaluator << endl;
+    if (options.evaluator == "kernel")
+    {
+        cerr << "Kernel filename: " << options.kernelFilename << endl;
+    }
+    cerr << "Leaf votes: " << options.vote << endl;
+    if (options.maskFile)
+    {
+        cerr << "Foreground mask: " << options.maskFilename
+             << " (background label " << options.backgroundLabel << ")" << endl;
+    }
+    if (options.maskByThreshold)
+    {
+        cerr << "Foreground threshold: " << options.maskThreshold
+             << " (background label " << options.backgroundLabel << ")" << endl;
+    }
+    if (options.cascade)
+    {
+        cerr << "Coarse forest: " << options.coarseForestFilename << " (shrink factor " << options.coarseShrink
+             << ", boundary radius " << options.coarseRadius << ", confidence " << options.coarseConfidence
+             << ")" << endl;
+    }
+    if (options.earlyExit)
+    {
+        cerr << "Early exit margin: " << options.earlyExitMargin << endl;
+    }
+    if (options.tiled)
+    {
+        if (!options.haloGiven)
+        {
+            cerr << "Tile size: " << options.tileSize << " (halo reached by the feature filters)" << endl;
+        }
+        else
+        {
+            cerr << "Tile size: " << options.tileSize << " (halo " << options.halo << ")" << endl;
+        }
+    }
+    if (options.probabilityMap)
+    {
+        cerr << "Probability map: " << options.probabilityFilename << " (" << options.probabilityType << ")" << endl;
+    }
+    if (options.leafMap)
+    {
+        cerr << "Leaf index map: " << options.leafFilename << endl;
+    }
+    if (options.voteSumMap)
+    {
+        cerr << "Vote sum map: " << options.voteSumFilename << endl;
+    }
+    if (options.updateVoteSums)
+    {
+        cerr << "Updating vote sum map: " << options.cachedVoteSumFilename
+             << " (of forest " << options.previousForestFilename << ")" << endl;
+    }
+    if (!options.threadsGiven)
+    {
+        cerr << "# of threads: all cores\n" << endl;
+    }
+    else
+    {
+        cerr << "# of threads: " << options.nThread << "\n" << endl;
+    }
+}
+
+// ================   PREDICTING FROM LEAF INDICES   ================
+// The leaves kept by an earlier run (-l) are voted by the forest again,
+// without computing any feature. The forest may have new leaf statistics
+// but must have the same trees.
+int PredictFromLeaves(const ApplyOptions &options)
+{
+    typedef itk::ImageFileReader<LeafImageType> LeafReaderType;
+    LeafReaderType::Pointer leafReader = LeafReaderType::New();
+    leafReader->SetFileName(options.cachedLeafFilename);
+
+    typedef itk::RFrepredict<LeafImageType, ImageType> RepredictType;
+    RepredictType::Pointer repredict = RepredictType::New();
+    repredict->SetInput(leafReader->GetOutput());
+    repredict->SetForestFileName(options.forestFilename);
+    repredict->SetNClass(options.nClass);
+    repredict->SetVoteMode(options.voteMode);
+    if (options.threadsGiven)
+    {
+        repredict->SetNumberOfThreads(options.nThread);
+    }
+
+    WriterType::Pointer labelWriter = WriterType::New();
+    labelWriter->SetFileName(options.outputFilename);
+    labelWriter->SetInput(repredict->GetOutput());
+    labelWriter->Update();
+    cerr << "Saved the full segmentation as: " << options.outputFilename << endl;
+
+    if (options.probabilityMap)
+    {
+        if (options.probabilityType == "uchar")
+        {
+            QuantizeType::Pointer quantize = QuantizeType::New();
+            quantize->SetInput(repredict->GetProbabilityOutput());
+            typedef itk::ImageFileWriter<ByteProbabilityImageType> ByteProbabilityWriterType;
+            ByteProbabilityWriterType::Pointer byteProbabilityWriter = ByteProbabilityWriterType::New();
+            byteProbabilityWriter->SetFileName(options.probabilityFilename);
+            byteProbabilityWriter->SetInput(quantize->GetOutput());
+            byteProbabilityWriter->Update();
+        }
+        else
+        {
+            typedef itk::ImageFileWriter<ProbabilityImageType> ProbabilityWriterType;
+            ProbabilityWriterType::Pointer probabilityWriter = ProbabilityWriterType::New();
+            probabilityWriter->SetFileName(options.probabilityFilename);
+            probabilityWriter->SetInput(repredict->GetProbabilityOutput());
+            probabilityWriter->Update();
+        }
+        cerr << "Saved the probability map as: " << options.probabilityFilename << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+// The filters from the reader of the input image to RFapply, which every
+// mode but the prediction from leaf indices classifies with. The rescalers
+// and the feature filters are held here as RFapply only holds their outputs.
+struct ApplyPipeline
+{
+    ApplyPipeline(): tiledTIFF(false), coarsePixels(0), coarseEarlyExitPixels(0) {}
+
+    readerType::Pointer reader;
+    bool tiledTIFF;
+    ExtractType::Pointer extract;
+    RedAdaptorType::Pointer redAdaptor;
+    GreenAdaptorType::Pointer greenAdaptor;
+    BlueAdaptorType::Pointer blueAdaptor;
+    vector<itk::ProcessObject::Pointer> filters;
+    RGBImageType::RegionType imageRegion;
+    vector<RGBImageType::RegionType> tiles;
+    applyType::Pointer apply;
+    VoteSumReaderType::Pointer voteSumReader;
+    MaskReaderType::Pointer maskReader;
+    MaskFilterType::Pointer maskFilter;
+    MaskImageType::Pointer maskImage;
+    ShrinkType::Pointer shrink;
+    CascadeType::Pointer cascadeFilter;
+    itk::SizeValueType coarsePixels;
+    itk::SizeValueType coarseEarlyExitPixels;
+};
+
+// Builds the pipeline of the input image, or of the images of a batch. A
+// tiled TIFF sets the tile size when none is given, and the feature filters
+// the halo of the tiles.
+void BuildPipeline(ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    // Basic Parameter
+    const unsigned short nComp = 15;
+
+    // Read input image
+    pipeline.reader = readerType::New();
+    pipeline.reader->SetFileName(options.inputFilename.c_str());
+
+    // A tiled TIFF, such as a whole slide, is read tile by tile as the
+    // pieces are classified, and classified by tiles of about 512 pixels
+    // made of its own
+    pipeline.tiledTIFF = !options.batch && itk::RFtiffImageIO::IsTiledTIFF(options.inputFilename);
+    if (pipeline.tiledTIFF)
+    {
+        itk::RFtiffImageIO::Pointer tiffIO = itk::RFtiffImageIO::New();
+        pipeline.reader->SetImageIO(tiffIO);
+        pipeline.reader->UpdateOutputInformation();
+        if (!options.tiled)
+        {
+            unsigned int nativeSize = std::max(tiffIO->GetTileWidth(), tiffIO->GetTileHeight());
+            options.tileSize = std::max(1u, (512 + nativeSize / 2) / nativeSize) * nativeSize;
+            options.tiled = true;
+        }
+        cerr << "Tiled TIFF: native tiles of " << tiffIO->GetTileWidth() << " x " << tiffIO->GetTileHeight()
+             << ", classified by tiles of " << options.tileSize << endl;
+    }
+
+    // Separate the RGB image
+    pipeline.redAdaptor = RedAdaptorType::New();
+    pipeline.greenAdaptor = GreenAdaptorType::New();
+    pipeline.blueAdaptor = BlueAdaptorType::New();
+
+    // In tiled mode the features are computed on one tile plus its halo
+    // at a time, extracted from the input
+    pipeline.extract = ExtractType::New();
+    pipeline.extract->SetInput(pipeline.reader->GetOutput());
+    pipeline.extract->SetDirectionCollapseToSubmatrix();
+
+    if (!options.tiled)
+    {
+        pipeline.redAdaptor->SetImage(pipeline.reader->GetOutput());
+        pipeline.greenAdaptor->SetImage(pipeline.reader->GetOutput());
+        pipeline.blueAdaptor->SetImage(pipeline.reader->GetOutput());
+    }
+    else
+    {
+        pipeline.redAdaptor->SetImage(pipeline.extract->GetOutput());
+        pipeline.greenAdaptor->SetImage(pipeline.extract->GetOutput());
+        pipeline.blueAdaptor->SetImage(pipeline.extract->GetOutput());
+    }
+
+    typedef itk::RescaleIntensityImageFilter<RedAdaptorType, ImageType> RedRescalerType;
+    typedef itk::RescaleIntensityImageFilter<GreenAdaptorType, ImageType> GreenRescalerType;
+    typedef itk::RescaleIntensityImageFilter<BlueAdaptorType, ImageType> BlueRescalerType;
+
+    RedRescalerType::Pointer redRescaler = RedRescalerType::New();
+    GreenRescalerType::Pointer greenRescaler = GreenRescalerType::New();
+    BlueRescalerType::Pointer blueRescaler = BlueRescalerType::New();
+
+    redRescaler->SetInput(pipeline.redAdaptor);
+    greenRescaler->SetInput(pipeline.greenAdaptor);
+    blueRescaler->SetInput(pipeline.blueAdaptor);
+
+    redRescaler->SetOutputMinimum(0);
+    redRescaler->SetOutputMaximum(255);
+    greenRescaler->SetOutputMinimum(0);
+    greenRescaler->SetOutputMaximum(255);
+    blueRescaler->SetOutputMinimum(0);
+    blueRescaler->SetOutputMaximum(255);
+
+    // The tiles are rescaled with the minimum and maximum of the whole
+    // image, which RescaleIntensityImageFilter would only see in one piece.
+    // IntensityWindowingImageFilter applies the same linear map.
+    typedef itk::IntensityWindowingImageFilter<RedAdaptorType, ImageType> RedWindowType;
+    typedef itk::IntensityWindowingImageFilter<GreenAdaptorType, ImageType> GreenWindowType;
+    typedef itk::IntensityWindowingImageFilter<BlueAdaptorType, ImageType> BlueWindowType;
+
+    RedWindowType::Pointer redWindow = RedWindowType::New();
+    GreenWindowType::Pointer greenWindow = GreenWindowType::New();
+    BlueWindowType::Pointer blueWindow = BlueWindowType::New();
+
+    redWindow->SetInput(pipeline.redAdaptor);
+    greenWindow->SetInput(pipeline.greenAdaptor);
+    blueWindow->SetInput(pipeline.blueAdaptor);
+
+    redWindow->SetOutputMinimum(0);
+    redWindow->SetOutputMaximum(255);
+    greenWindow->SetOutputMinimum(0);
+    greenWindow->SetOutputMaximum(255);
+    blueWindow->SetOutputMinimum(0);
+    blueWindow->SetOutputMaximum(255);
+
+    // List the tiles covering the image (a batch has no single image)
+    RGBImageType::RegionType &imageRegion = pipeline.imageRegion;
+    if (!options.batch)
+    {
+        pipeline.reader->UpdateOutputInformation();
+        imageRegion = pipeline.reader->GetOutput()->GetLargestPossibleRegion();
+    }
+    if (options.tiled)
+    {
+        for (unsigned long y = 0; y < imageRegion.GetSize(1); y += options.tileSize)
+        {
+            for (unsigned long x = 0; x < imageRegion.GetSize(0); x += options.tileSize)
+            {
+                RGBImageType::IndexType tileIndex;
+                tileIndex[0] = imageRegion.GetIndex(0) + x;
+                tileIndex[1] = imageRegion.GetIndex(1) + y;
+                RGBImageType::SizeType tileExtent;
+                tileExtent[0] = std::min<unsigned long>(options.tileSize, imageRegion.GetSize(0) - x);
+                tileExtent[1] = std::min<unsigned long>(options.tileSize, imageRegion.GetSize(1) - y);
+                pipeline.tiles.push_back(RGBImageType::RegionType(tileIndex, tileExtent));
+            }
+        }
+
+        // Find the range of every channel, one tile at a time
+        float minimum[3] = {itk::NumericTraits<float>::max(), itk::NumericTraits<float>::max(),
+                            itk::NumericTraits<float>::max()};
+        float maximum[3] = {itk::NumericTraits<float>::NonpositiveMin(),
+                            itk::NumericTraits<float>::NonpositiveMin(),
+                            itk::NumericTraits<float>::NonpositiveMin()};
+        typedef itk::ImageRegionConstIterator<RGBImageType> RGBIteratorType;
+        for (unsigned int t = 0; t < pipeline.tiles.size(); t++)
+        {
+            pipeline.extract->SetExtractionRegion(pipeline.tiles[t]);
+            pipeline.extract->Update();
+            RGBIteratorType rgbIT(pipeline.extract->GetOutput(), pipeline.tiles[t]);
+            for (rgbIT.GoToBegin(); !rgbIT.IsAtEnd(); ++rgbIT)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    minimum[c] = std::min(minimum[c], rgbIT.Get()[c]);
+                    maximum[c] = std::max(maximum[c], rgbIT.Get()[c]);
+                }
+            }
+        }
+        redWindow->SetWindowMinimum(minimum[0]);
+        redWindow->SetWindowMaximum(maximum[0]);
+        greenWindow->SetWindowMinimum(minimum[1]);
+        greenWindow->SetWindowMaximum(maximum[1]);
+        blueWindow->SetWindowMinimum(minimum[2]);
+        blueWindow->SetWindowMaximum(maximum[2]);
+    }
+
+    ImageType::Pointer redImage = redRescaler->GetOutput();
+    ImageType::Pointer greenImage = greenRescaler->GetOutput();
+    ImageType::Pointer blueImage = blueRescaler->GetOutput();
+    if (options.tiled)
+    {
+        redImage = redWindow->GetOutput();
+        greenImage = greenWindow->GetOutput();
+        blueImage = blueWindow->GetOutput();
+    }
+
+
+    // ================   FEATURE GENERATION   ================
+    // Gaussian Image Filter
+    typedef itk::DiscreteGaussianImageFilter<ImageType,ImageType> gaussType;
+    gaussType::Pointer gaussFilter1 = gaussType::New();
+    gaussType::Pointer gaussFilter2 = gaussType::New();
+    gaussType::Pointer gaussFilter3 = gaussType::New();
+    gaussFilter1->SetInput(redImage);
+    gaussFilter1->SetVariance(2.56);
+    gaussFilter2->SetInput(greenImage);
+    gaussFilter2->SetVariance(2.56);
+    gaussFilter3->SetInput(blueImage);
+    gaussFilter3->SetVariance(2.56);
+
+    // BL Filter
+    typedef itk::BilateralImageFilter<ImageType,ImageType> bilateralType;
+    bilateralType::Pointer bilateralFilter1 = bilateralType::New();
+    bilateralType::Pointer bilateralFilter2 = bilateralType::New();
+    bilateralType::Pointer bilateralFilter3 = bilateralType::New();
+    bilateralFilter1->SetInput(redImage);
+    bilateralFilter2->SetInput(greenImage);
+    bilateralFilter3->SetInput(blueImage);
+
+    // Laplacian Filter
+    typedef itk::LaplacianImageFilter<ImageType,ImageType> laplacianType;
+    laplacianType::Pointer laplacianFilter1 = laplacianType::New();
+    laplacianType::Pointer laplacianFilter2 = laplacianType::New();
+    laplacianType::Pointer laplacianFilter3 = laplacianType::New();
+    laplacianFilter1->SetInput(redImage);
+    laplacianFilter2->SetInput(greenImage);
+    laplacianFilter3->SetInput(blueImage);
+
+    // Gradient Magnitude Filter
+    typedef itk::GradientMagnitudeImageFilter<ImageType,ImageType> gradmagType;
+    gradmagType::Pointer gradmagFilter1 = gradmagType::New();
+    gradmagType::Pointer gradmagFilter2 = gradmagType::New();
+    gradmagType::Pointer gradmagFilter3 = gradmagType::New();
+    gradmagFilter1->SetInput(redImage);
+    gradmagFilter2->SetInput(greenImage);
+    gradmagFilter3->SetInput(blueImage);
+
+    // Hessian Filter
+    typedef itk::HessianRecursiveGaussianImageFilter<ImageType,ImageType> hessType;
+    hessType::Pointer hessFilter1 = hessType::New();
+    hessType::Pointer hessFilter2 = hessType::New();
+    hessType::Pointer hessFilter3 = hessType::New();
+    hessFilter1->SetInput(redImage);
+    hessFilter2->SetInput(greenImage);
+    hessFilter3->SetInput(blueImage);
+
+    itk::ProcessObject *filters[] = {
+                                     redRescaler, greenRescaler, blueRescaler,
+                                     redWindow, greenWindow, blueWindow,
+                                     gaussFilter1, gaussFilter2, gaussFilter3,
+                                     bilateralFilter1, bilateralFilter2, bilateralFilter3,
+                                     laplacianFilter1, laplacianFilter2, laplacianFilter3,
+                                     gradmagFilter1, gradmagFilter2, gradmagFilter3,
+                                     hessFilter1, hessFilter2, hessFilter3
+                                    };
+    pipeline.filters.assign(filters, filters + sizeof(filters) / sizeof(filters[0]));
+
+    // Tiles are padded by the pixels their features depend on, so they
+    // get the features of a whole image run
+    if (options.tiled)
+    {
+        unsigned int featureHalo = FeatureHalo(gaussFilter1.GetPointer(), bilateralFilter1.GetPointer(),
+                                               hessFilter1.GetPointer(), pipeline.reader->GetOutput()->GetSpacing());
+        if (!options.haloGiven)
+        {
+            options.halo = featureHalo;
+            cerr << "Tile halo: " << options.halo << " pixels" << endl;
+        }
+        else if (options.halo < featureHalo)
+        {
+            cerr << "WARNING: The feature filters reach " << featureHalo << " pixels, features near the tile "
+                 << "borders will differ from a whole image run!" << endl;
+        }
+    }
+
+    cerr << "Preprocessing Has Started..." << endl;
+
+     // ================   APPLYING CLASSIFICATION   ================
+
+    ImageType::Pointer Input[15] = {
+                                    gaussFilter1->GetOutput(),
+                                    gaussFilter2->GetOutput(),
+                                    gaussFilter3->GetOutput(),
+                                    bilateralFilter1->GetOutput(),
+                                    bilateralFilter2->GetOutput(),
+                                    bilateralFilter3->GetOutput(),
+                                    laplacianFilter1->GetOutput(),
+                                    laplacianFilter2->GetOutput(),
+                                    laplacianFilter3->GetOutput(),
+                                    gradmagFilter1->GetOutput(),
+                                    gradmagFilter2->GetOutput(),
+                                    gradmagFilter3->GetOutput(),
+                                    hessFilter1->GetOutput(),
+                                    hessFilter2->GetOutput(),
+                                    hessFilter3->GetOutput()
+                                   };
+
+    // Declare and instantiate the RF sampling filter
+    applyType::Pointer apply = applyType::New();
+    pipeline.apply = apply;
+    apply->SetNComp(nComp);
+    apply->SetNClass(options.nClass);
+    apply->SetForestFileName(options.forestFilename);
+    if (options.evaluator == "qs")
+    {
+        apply->SetEvaluator(applyType::QuickScorerEvaluator);
+    }
+    else if (options.evaluator == "kernel")
+    {
+        apply->SetEvaluator(applyType::KernelEvaluator);
+        apply->SetKernelFileName(options.kernelFilename);
+    }
+    apply->SetCheckEvaluator(options.checkEvaluator);
+    apply->SetProbabilityOutput(options.probabilityMap);
+    apply->SetLeafOutput(options.leafMap);
+    apply->SetVoteSumOutput(options.voteSumMap);
+    apply->SetVoteMode(options.voteMode);
+    if (options.earlyExit)
+    {
+        apply->SetEarlyExit(true);
+        apply->SetEarlyExitMargin(options.earlyExitMargin);
+    }
+    if (options.threadsGiven)
+    {
+        apply->SetNumberOfThreads(options.nThread);
+    }
+    for (int i = 0; i < nComp; i++)
+    {
+        apply->SetInputImage(Input[i]);
+    }
+    apply->SetDummyImage(redImage);
+}
+
+// ================   UPDATING VOTE SUMS   ================
+// The vote sums of an earlier run are read piece by piece with the pixels
+// classified, and only the trees the forests do not share are travelled
+void SetCachedVoteSums(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    pipeline.voteSumReader = VoteSumReaderType::New();
+    pipeline.voteSumReader->SetFileName(options.cachedVoteSumFilename);
+    pipeline.apply->SetCachedVoteSums(pipeline.voteSumReader->GetOutput());
+    pipeline.apply->SetPreviousForestFileName(options.previousForestFilename);
+}
+
+// ================   MASKING   ================
+// Foreground masks, read or thresholded from the input image
+void BuildMask(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    if (options.maskFile)
+    {
+        pipeline.maskReader = MaskReaderType::New();
+        pipeline.maskReader->SetFileName(options.maskFilename);
+        pipeline.maskImage = pipeline.maskReader->GetOutput();
+    }
+    else
+    {
+        pipeline.maskFilter = MaskFilterType::New();
+        pipeline.maskFilter->SetInput(pipeline.reader->GetOutput());
+        pipeline.maskFilter->SetThreshold(options.maskThreshold);
+        pipeline.maskImage = pipeline.maskFilter->GetOutput();
+    }
+}
+
+// ================   COARSE-TO-FINE CASCADE   ================
+// The shrunk image is classified whole with the coarse forest, through the
+// same features, then RFcascade masks the pixels to classify again at full
+// resolution. The other pixels keep the coarse labels and probabilities.
+void ClassifyCoarse(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    applyType *apply = pipeline.apply;
+    pipeline.shrink = ShrinkType::New();
+    pipeline.shrink->SetInput(pipeline.reader->GetOutput());
+    pipeline.shrink->SetShrinkFactors(options.coarseShrink);
+    pipeline.redAdaptor->SetImage(pipeline.shrink->GetOutput());
+    pipeline.greenAdaptor->SetImage(pipeline.shrink->GetOutput());
+    pipeline.blueAdaptor->SetImage(pipeline.shrink->GetOutput());
+    apply->SetForestFileName(options.coarseForestFilename);
+    // RFcascade needs the coarse probabilities, to find the unsure pixels
+    apply->SetProbabilityOutput(true);
+    apply->UpdateLargestPossibleRegion();
+
+    ImageType::Pointer coarseLabels = apply->GetOutput();
+    ProbabilityImageType::Pointer coarseProbabilities = apply->GetProbabilityOutput();
+    coarseLabels->DisconnectPipeline();
+    coarseProbabilities->DisconnectPipeline();
+    pipeline.coarsePixels = apply->GetForegroundPixels();
+    pipeline.coarseEarlyExitPixels = apply->GetEarlyExitPixels();
+    cerr << "Classified the coarse image: " << pipeline.coarsePixels << " pixels" << endl;
+
+    // Back to the tiles of the full resolution image
+    pipeline.redAdaptor->SetImage(pipeline.extract->GetOutput());
+    pipeline.greenAdaptor->SetImage(pipeline.extract->GetOutput());
+    pipeline.blueAdaptor->SetImage(pipeline.extract->GetOutput());
+    apply->SetForestFileName(options.forestFilename);
+    apply->SetProbabilityOutput(options.probabilityMap);
+
+    pipeline.cascadeFilter = CascadeType::New();
+    pipeline.cascadeFilter->SetInput(coarseLabels);
+    pipeline.cascadeFilter->SetProbabilityImage(coarseProbabilities);
+    pipeline.cascadeFilter->SetOutputParametersFromImage(pipeline.reader->GetOutput());
+    pipeline.cascadeFilter->SetBoundaryRadius(options.coarseRadius);
+    pipeline.cascadeFilter->SetConfidence(options.coarseConfidence);
+    if (options.threadsGiven)
+    {
+        pipeline.cascadeFilter->SetNumberOfThreads(options.nThread);
+    }
+    pipeline.maskImage = pipeline.cascadeFilter->GetOutput();
+    apply->SetFallbackLabels(pipeline.cascadeFilter->GetLabelOutput());
+    apply->SetFallbackProbabilities(pipeline.cascadeFilter->GetProbabilityOutput());
+}
+
+// ================   BATCH   ================
+// The forest is read once, with the first image, and the pipeline and the
+// threads of the filters are kept for every image. While image k is
+// classified, image k+1 is read and the labels of image k-1 written by
+// helper threads.
+int ClassifyBatch(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    const vector<string> &batchInputs = options.batchInputs;
+    const vector<string> &batchOutputs = options.batchOutputs;
+
+    typedef itk::StreamingImageFilter<ImageType, ImageType> StreamingFilterType;
+    StreamingFilterType::Pointer streamingFilter = StreamingFilterType::New();
+    streamingFilter->SetInput(pipeline.apply->GetOutput());
+    streamingFilter->SetNumberOfStreamDivisions(options.nStream);
+
+    itk::MultiThreader::Pointer ioThreader = itk::MultiThreader::New();
+    BatchReadJob readJob;
+    BatchWriteJob writeJob;
+    itk::ThreadIdType readThread = 0;
+    itk::ThreadIdType writeThread = 0;
+    bool writing = false;
+    unsigned int failed = 0;
+    itk::SizeValueType batchPixels = 0;
+
+    readJob.fileName = batchInputs[0];
+    readThread = ioThreader->SpawnThread(BatchReadImage, &readJob);
+    for (unsigned int k = 0; k < batchInputs.size(); k++)
+    {
+        ioThreader->TerminateThread(readThread);
+        RGBImageType::Pointer image = readJob.image;
+        string readError = readJob.error;
+        if (k + 1 < batchInputs.size())
+        {
+            readJob.fileName = batchInputs[k+1];
+            readJob.image = NULL;
+            readJob.error.clear();
+            readThread = ioThreader->SpawnThread(BatchReadImage, &readJob);
+        }
+        if (image.IsNull())
+        {
+            cerr << "ERROR: Cannot read " << batchInputs[k] << ": " << readError << endl;
+            failed++;
+            continue;
+        }
+
+        pipeline.redAdaptor->SetImage(image);
+        pipeline.greenAdaptor->SetImage(image);
+        pipeline.blueAdaptor->SetImage(image);
+        if (options.maskByThreshold)
+        {
+            pipeline.maskFilter->SetInput(image);
+        }
+        ImageType::Pointer batchLabels;
+        try
+        {
+            // Images of a batch need not have the same size
+            streamingFilter->UpdateLargestPossibleRegion();
+            batchLabels = streamingFilter->GetOutput();
+            batchLabels->DisconnectPipeline();
+        }
+        catch (itk::ExceptionObject &error)
+        {
+            cerr << "ERROR: Cannot classify " << batchInputs[k] << ": " << error.GetDescription() << endl;
+            failed++;
+            continue;
+        }
+        batchPixels += image->GetLargestPossibleRegion().GetNumberOfPixels();
+
+        if (writing)
+        {
+            ioThreader->TerminateThread(writeThread);
+            if (!writeJob.error.empty())
+            {
+                cerr << "ERROR: Cannot write " << writeJob.fileName << ": " << writeJob.error << endl;
+                failed++;
+            }
+        }
+        writeJob.fileName = batchOutputs[k];
+        writeJob.labels = batchLabels;
+        writeJob.error.clear();
+        writeThread = ioThreader->SpawnThread(BatchWriteLabels, &writeJob);
+        writing = true;
+        cerr << "Classified " << batchInputs[k] << " (" << k + 1 << " of " << batchInputs.size()
+             << "), saving as: " << batchOutputs[k] << endl;
+    }
+    if (writing)
+    {
+        ioThreader->TerminateThread(writeThread);
+        if (!writeJob.error.empty())
+        {
+            cerr << "ERROR: Cannot write " << writeJob.fileName << ": " << writeJob.error << endl;
+            failed++;
+        }
+    }
+
+    cerr << "Saved the segmentations of " << batchInputs.size() - failed << " of "
+         << batchInputs.size() << " images" << endl;
+    if (options.earlyExit)
+    {
+        cerr << "Pixels classified before the last tree: " << pipeline.apply->GetEarlyExitPixels()
+             << " of " << batchPixels << endl;
+    }
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Classifies the whole image, streamed to the output file in divisions
+void ClassifyWhole(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    typedef itk::StreamingImageFilter<ImageType, ImageType> StreamingFilterType;
+    StreamingFilterType::Pointer streamingFilter = StreamingFilterType::New();
+    streamingFilter->SetInput(pipeline.apply->GetOutput());
+    streamingFilter->SetNumberOfStreamDivisions(options.nStream);
+
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(options.outputFilename);
+    writer->SetInput(streamingFilter->GetOutput());
+    writer->SetNumberOfStreamDivisions(options.nStream);
+    writer->Update();
+}
+
+// Whether the mask has any foreground pixel in the piece
+bool HasForeground(MaskImageType *maskImage, const RGBImageType::RegionType piece)
+{
+    maskImage->UpdateOutputInformation();
+    maskImage->SetRequestedRegion(piece);
+    maskImage->PropagateRequestedRegion();
+    maskImage->UpdateOutputData();
+    typedef itk::ImageRegionConstIterator<MaskImageType> MaskIteratorType;
+    MaskIteratorType maskIT(maskImage, piece);
+    for (maskIT.GoToBegin(); !maskIT.IsAtEnd(); ++maskIT)
+    {
+        if (maskIT.Get() != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A piece with nothing to refine keeps the coarse predictions, generated
+// for it with the mask. RFcascade gives them with the geometry of the
+// whole image.
+void WriteCoarsePiece(const ApplyOptions &options, ApplyPipeline &pipeline, ImageType *labels,
+                      const RGBImageType::RegionType piece, const itk::ImageIORegion ioRegion)
+{
+    typedef itk::ImageRegionConstIterator<ImageType> ConstIteratorType;
+    typedef itk::ImageRegionIterator<ImageType> IteratorType;
+    ConstIteratorType coarseIT(pipeline.cascadeFilter->GetLabelOutput(), piece);
+    IteratorType labelIT(labels, piece);
+    for (coarseIT.GoToBegin(), labelIT.GoToBegin(); !coarseIT.IsAtEnd(); ++coarseIT, ++labelIT)
+    {
+        labelIT.Set(coarseIT.Get());
+    }
+    if (options.probabilityMap && (options.probabilityType == "uchar"))
+    {
+        QuantizeType::Pointer coarseQuantize = QuantizeType::New();
+        coarseQuantize->SetInput(pipeline.cascadeFilter->GetProbabilityOutput());
+        typedef itk::ImageFileWriter<ByteProbabilityImageType> ByteProbabilityWriterType;
+        ByteProbabilityWriterType::Pointer coarseByteProbabilityWriter = ByteProbabilityWriterType::New();
+        coarseByteProbabilityWriter->SetFileName(options.probabilityFilename);
+        coarseByteProbabilityWriter->SetInput(coarseQuantize->GetOutput());
+        coarseByteProbabilityWriter->SetIORegion(ioRegion);
+        coarseByteProbabilityWriter->Update();
+    }
+    else if (options.probabilityMap)
+    {
+        typedef itk::ImageFileWriter<ProbabilityImageType> ProbabilityWriterType;
+        ProbabilityWriterType::Pointer coarseProbabilityWriter = ProbabilityWriterType::New();
+        coarseProbabilityWriter->SetFileName(options.probabilityFilename);
+        coarseProbabilityWriter->SetInput(pipeline.cascadeFilter->GetProbabilityOutput());
+        coarseProbabilityWriter->SetIORegion(ioRegion);
+        coarseProbabilityWriter->Update();
+    }
+}
+
+// A piece of background only is neither filtered nor classified, it gets
+// the background label and its maps zeros
+void WriteBackgroundPiece(const ApplyOptions &options, ImageType *labels,
+                          const RGBImageType::RegionType piece, const itk::ImageIORegion ioRegion)
+{
+    typedef itk::ImageRegionIterator<ImageType> IteratorType;
+    IteratorType labelIT(labels, piece);
+    for (labelIT.GoToBegin(); !labelIT.IsAtEnd(); ++labelIT)
+    {
+        labelIT.Set(options.backgroundLabel);
+    }
+    if (options.probabilityMap && (options.probabilityType == "uchar"))
+    {
+        WriteEmptyPiece<ByteProbabilityImageType>(options.probabilityFilename, options.nClass, labels,
+                                                  piece, ioRegion);
+    }
+    else if (options.probabilityMap)
+    {
+        WriteEmptyPiece<ProbabilityImageType>(options.probabilityFilename, options.nClass, labels,
+                                              piece, ioRegion);
+    }
+    if (options.voteSumMap)
+    {
+        WriteEmptyPiece<VoteSumImageType>(options.voteSumFilename, options.nClass, labels,
+                                          piece, ioRegion);
+    }
+}
+
+// Classifies a piece into its labels. The maps of the piece, computed with
+// its labels, are pasted as pieces of the whole image, as the labels are.
+void ClassifyPiece(const ApplyOptions &options, ApplyPipeline &pipeline, ImageType *labels,
+                   const RGBImageType::RegionType piece, const itk::ImageIORegion ioRegion)
+{
+    applyType *apply = pipeline.apply;
+    apply->UpdateOutputInformation();
+    apply->GetOutput()->SetRequestedRegion(piece);
+    apply->GetOutput()->PropagateRequestedRegion();
+    apply->GetOutput()->UpdateOutputData();
+
+    typedef itk::ImageRegionConstIterator<ImageType> ConstIteratorType;
+    typedef itk::ImageRegionIterator<ImageType> IteratorType;
+    ConstIteratorType pieceIT(apply->GetOutput(), piece);
+    IteratorType labelIT(labels, piece);
+    for (pieceIT.GoToBegin(), labelIT.GoToBegin(); !pieceIT.IsAtEnd(); ++pieceIT, ++labelIT)
+    {
+        labelIT.Set(pieceIT.Get());
+    }
+
+    if (options.probabilityMap && (options.probabilityType == "uchar"))
+    {
+        QuantizeType::Pointer quantize = QuantizeType::New();
+        quantize->SetInput(apply->GetProbabilityOutput());
+        ByteProbabilityImageType *byteProbabilities = quantize->GetOutput();
+        byteProbabilities->UpdateOutputInformation();
+        byteProbabilities->SetRequestedRegion(piece);
+        byteProbabilities->PropagateRequestedRegion();
+        byteProbabilities->UpdateOutputData();
+        WritePiece<ByteProbabilityImageType>(options.probabilityFilename, byteProbabilities, labels, ioRegion);
+    }
+    else if (options.probabilityMap)
+    {
+        WritePiece<ProbabilityImageType>(options.probabilityFilename, apply->GetProbabilityOutput(),
+                                         labels, ioRegion);
+    }
+    if (options.leafMap)
+    {
+        WritePiece<LeafImageType>(options.leafFilename, apply->GetLeafOutput(), labels, ioRegion);
+    }
+    if (options.voteSumMap)
+    {
+        WritePiece<VoteSumImageType>(options.voteSumFilename, apply->GetVoteSumOutput(), labels, ioRegion);
+    }
+}
+
+// ================   TILES AND STRIPS   ================
+// Classifies one tile or strip at a time and keeps only its labels. In
+// tiled mode its features are computed from the tile plus its halo and
+// dropped with it. The probabilities of the same pixels are pasted into the
+// probability map file, and so are their leaf indices and vote sums into
+// their map files. False if a tile cannot be read.
+bool ClassifyPieces(const ApplyOptions &options, ApplyPipeline &pipeline)
+{
+    const RGBImageType::RegionType &imageRegion = pipeline.imageRegion;
+    vector<RGBImageType::RegionType> pieces = pipeline.tiles;
+    if (!options.tiled)
+    {
+        unsigned long rows = imageRegion.GetSize(1);
+        for (unsigned long s = 0; s < options.nStream; s++)
+        {
+            RGBImageType::RegionType strip = imageRegion;
+            strip.SetIndex(1, imageRegion.GetIndex(1) + rows * s / options.nStream);
+            strip.SetSize(1, rows * (s + 1) / options.nStream - rows * s / options.nStream);
+            if (strip.GetSize(1) > 0)
+            {
+                pieces.push_back(strip);
+            }
+        }
+    }
+
+    // The labels of every piece are pasted into the output file when its
+    // format allows, so no image is ever held whole. It always does for a
+    // tiled TIFF (see ParseOptions), other inputs are read whole anyway.
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(options.outputFilename);
+    itk::ImageIOBase::Pointer labelIO =
+        itk::ImageIOFactory::CreateImageIO(options.outputFilename.c_str(), itk::ImageIOFactory::WriteMode);
+    bool streamLabels = labelIO.IsNotNull() && labelIO->CanStreamWrite();
+    ImageType::Pointer labels = ImageType::New();
+    labels->CopyInformation(pipeline.reader->GetOutput());
+    typedef itk::RFpiece<ImageType> LabelPieceType;
+    LabelPieceType::Pointer labelPiece = LabelPieceType::New();
+    if (streamLabels)
+    {
+        itksys::SystemTools::RemoveFile(options.outputFilename.c_str());
+        writer->SetInput(labelPiece->GetOutput());
+    }
+    else
+    {
+        labels->SetRegions(imageRegion);
+        labels->Allocate();
+    }
+    if (options.probabilityMap)
+    {
+        // Pieces are pasted into an existing file of the right size,
+        // so never into one left by an earlier run
+        itksys::SystemTools::RemoveFile(options.probabilityFilename.c_str());
+    }
+    if (options.leafMap)
+    {
+        itksys::SystemTools::RemoveFile(options.leafFilename.c_str());
+    }
+    if (options.voteSumMap)
+    {
+        itksys::SystemTools::RemoveFile(options.voteSumFilename.c_str());
+    }
+
+    // In tiled mode the tiles, padded by the halo, are read by their own
+    // reader, the next one by a helper thread while the current one is
+    // classified
+    vector<RGBImageType::RegionType> padded(pieces.size());
+    for (unsigned int t = 0; t < pieces.size(); t++)
+    {
+        padded[t] = pieces[t];
+        padded[t].PadByRadius(options.halo);
+        padded[t].Crop(imageRegion);
+    }
+    readerType::Pointer tileReader = readerType::New();
+    tileReader->SetFileName(options.inputFilename.c_str());
+    if (pipeline.tiledTIFF)
+    {
+        tileReader->SetImageIO(itk::RFtiffImageIO::New());
+    }
+    TileReadJob tileJob;
+    tileJob.extract = ExtractType::New();
+    tileJob.extract->SetInput(tileReader->GetOutput());
+    tileJob.extract->SetDirectionCollapseToSubmatrix();
+    itk::MultiThreader::Pointer tileThreader = itk::MultiThreader::New();
+    itk::ThreadIdType tileThread = 0;
+    if (options.tiled && !pieces.empty())
+    {
+        tileJob.region = padded[0];
+        tileThread = tileThreader->SpawnThread(ReadTile, &tileJob);
+    }
+
+    for (unsigned int t = 0; t < pieces.size(); t++)
+    {
+        itk::ImageIORegion ioRegion(2);
+        for (unsigned int d = 0; d < 2; d++)
+        {
+            ioRegion.SetIndex(d, pieces[t].GetIndex(d) - imageRegion.GetIndex(d));
+            ioRegion.SetSize(d, pieces[t].GetSize(d));
+        }
+        if (streamLabels)
+        {
+            labels->SetBufferedRegion(pieces[t]);
+            labels->SetRequestedRegion(pieces[t]);
+            labels->Allocate();
+        }
+
+        if (options.tiled)
+        {
+            tileThreader->TerminateThread(tileThread);
+            RGBImageType::Pointer tile = tileJob.tile;
+            if (tile.IsNull())
+            {
+                cerr << "ERROR: Cannot read the tile " << t << ": " << tileJob.error << endl;
+                return false;
+            }
+            tileJob.tile = NULL;
+            if (t + 1 < pieces.size())
+            {
+                tileJob.region = padded[t+1];
+                tileThread = tileThreader->SpawnThread(ReadTile, &tileJob);
+            }
+            pipeline.redAdaptor->SetImage(tile);
+            pipeline.greenAdaptor->SetImage(tile);
+            pipeline.blueAdaptor->SetImage(tile);
+            if (options.maskByThreshold)
+            {
+                pipeline.maskFilter->SetInput(tile);
+            }
+        }
+
+        bool foreground = !options.masked || HasForeground(pipeline.maskImage, pieces[t]);
+        if (!foreground && options.cascade)
+        {
+            WriteCoarsePiece(options, pipeline, labels, pieces[t], ioRegion);
+        }
+        else if (!foreground)
+        {
+            WriteBackgroundPiece(options, labels, pieces[t], ioRegion);
+        }
+        else
+        {
+            ClassifyPiece(options, pipeline, labels, pieces[t], ioRegion);
+        }
+
+        if (streamLabels)
+        {
+            labelPiece->SetPiece(labels);
+            writer->SetIORegion(ioRegion);
+            writer->Update();
+        }
+    }
+
+    // Save the results to a .nii file, unless already pasted piece by piece
+    if (!streamLabels)
+    {
+        writer->SetInput(labels);
+        writer->Update();
+    }
+    return true;
+}
+
+// The pixels classified, reported once the segmentation is saved
+void ReportPixels(const ApplyOptions &options, const ApplyPipeline &pipeline)
+{
+    itk::SizeValueType imagePixels = pipeline.imageRegion.GetNumberOfPixels();
+    if (options.cascade)
+    {
+        itk::SizeValueType refinedPixels = pipeline.apply->GetForegroundPixels() - pipeline.coarsePixels;
+        cerr << "Pixels refined at full resolution: " << refinedPixels << " of "
+             << imagePixels << " (" << 100.0 * refinedPixels / imagePixels << "%)" << endl;
+    }
+    else if (options.masked)
+    {
+        cerr << "Pixels classified in the mask: " << pipeline.apply->GetForegroundPixels()
+             << " of " << imagePixels << endl;
+    }
+    if (options.earlyExit)
+    {
+        cerr << "Pixels classified before the last tree: "
+             << pipeline.apply->GetEarlyExitPixels() - pipeline.coarseEarlyExitPixels
+             << " of " << imagePixels << endl;
+    }
+    if (options.updateVoteSums)
+    {
+        cerr << "Trees travelled per pixel to update the vote sums: " << pipeline.apply->GetUpdatedTreeNum()
+             << " (instead of " << pipeline.apply->GetForest()->GetCompiledForest().TreeNum() << ")" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+
+{
+
+    /*
+     *      This method trains an RF classifier and saves
+     *      the forest.dat file for use in classification
+     *
+     *      Requires two input arguments:
+     *         -i   Input Testing Image
+     *         -o   Output Filename (the output directory for a -b directory,
+     *              a format written in pieces such as .mha for a tiled TIFF)
+     *         -b   Batch, a list file of "input output" lines or a directory of images
+     *         -f   Input Forest Filename
+     *         -nc  Number of Classes
+     *         -sd  Number of Streaming Divisions
+     *         -e   Forest Evaluator (tree, qs or kernel, optional)
+     *         -k   Kernel Filename, built from icell_compile's source (for -e kernel)
+     *         -check  Check the evaluator against DecisionTree::Apply
+     *         -v   Leaf Votes (exact, fixed16, fixed8 or hard, optional)
+     *         -ee  Early Exit Margin (0 for exact labels, optional)
+     *         -tile  Tile Size, computes the features tile by tile (optional)
+     *         -halo  Tile Halo in pixels (optional, what the feature filters reach by default)
+     *         -p   Output Probability Map Filename (optional)
+     *         -pt  Probability Map Type (float or uchar, optional)
+     *         -l   Output Leaf Index Map Filename, the leaf of every tree (optional, without -m or -mt)
+     *         -rl  Input Leaf Index Map, predicts from it instead of -i (optional)
+     *         -vs  Output Vote Sum Map Filename, the summed votes of the trees (optional)
+     *         -pvs Input Vote Sum Map of an earlier run, updated to the forest (optional)
+     *         -pf  Previous Forest Filename, the forest that gave the -pvs map
+     *         -m   Foreground Mask Filename, non-zero on the pixels to classify (optional)
+     *         -mt  Foreground Threshold, masks the pixels darker than it (optional)
+     *         -bl  Background Label of the pixels out of the mask (optional, 0 by default)
+     *         -cf  Coarse Forest Filename, classifies a shrunk image first and refines
+     *              at full resolution only its boundaries and unsure pixels (optional)
+     *         -cs  Coarse Shrink Factor, as given to icell_train -sf (optional, 4 by default)
+     *         -cr  Coarse Boundary Radius in coarse pixels (optional, 1 by default)
+     *         -cc  Coarse Confidence, refines the pixels less probable (optional, 0.6 by default)
+     *         -nt  Number of Threads (optional, all cores by default)
+     *
+                                                          */
+
+    cerr << " \n\n\t\tiCell Apply \n\t\tby Hyo Min Lee \n\n" << endl;
+
+    // Parse command line arguments
+    ApplyOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        return EXIT_FAILURE;
+    }
+    PrintOptions(options);
+
+    if (options.predictLeaves)
+    {
+        return PredictFromLeaves(options);
+    }
+
+    ApplyPipeline pipeline;
+    BuildPipeline(options, pipeline);
+    if (options.updateVoteSums)
+    {
+        SetCachedVoteSums(options, pipeline);
+    }
+    if (options.maskFile || options.maskByThreshold)
+    {
+        BuildMask(options, pipeline);
+    }
+    if (options.cascade)
+    {
+        ClassifyCoarse(options, pipeline);
+    }
+    if (options.masked)
+    {
+        pipeline.apply->SetMaskImage(pipeline.maskImage);
+        pipeline.apply->SetBackgroundLabel(options.backgroundLabel);
+    }
+
+    if (options.batch)
+    {
+        return ClassifyBatch(options, pipeline);
+    }
+    if (!options.tiled && !options.probabilityMap && !options.leafMap && !options.voteSumMap)
+    {
+        ClassifyWhole(options, pipeline);
+    }
+    else if (!ClassifyPieces(options, pipeline))
+    {
+        return EXIT_FAILURE;
+    }
 
-    cerr << "Saved the full segmentation as: " << outputFilename << endl;
+    cerr << "Saved the full segmentation as: " << options.outputFilename << endl;
+    ReportPixels(options, pipeline);
 
     return EXIT_SUCCESS;
 }
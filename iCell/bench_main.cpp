@@ -0,0 +1,230 @@
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "Library/classification.h"
+#include "Library/nodekernels.h"
+#include "Library/utility.h"
+
+
+using namespace std;
+
+// the bucketing of CandidateIG before the node kernels, one branch per
+// threshold passed
+static void BucketWhile(const double* responses, size_t n,
+                        const double* thresholds, size_t thresholdNum,
+                        unsigned int* buckets)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned int which = 0;
+        while ((which < thresholdNum) && (responses[i] >= thresholds[which]))
+        {
+            ++which;
+        }
+        buckets[i] = which;
+    }
+}
+
+// the Partition of tree.h before the node kernels, swapping from both ends
+static size_t PartitionSwap(std::vector<bool>& response, std::vector<index_t>& index,
+                            index_t begin, index_t end)
+{
+    index_t i = begin;
+    index_t j = end - 1;
+    while (i != j)
+    {
+        while ((response[i] == false) && (i != j))
+        {
+            ++i;
+        }
+        while ((response[j] == true) && (i != j))
+        {
+            --j;
+        }
+        if (i != j)
+        {
+            index_t tmpIdx = index[i];
+            bool tmpResps = response[i];
+            index[i] = index[j];
+            response[i] = response[j];
+            index[j] = tmpIdx;
+            response[j] = tmpResps;
+        }
+    }
+    return (response[i] == false ? i + 1 : i);
+}
+
+int main(int argc, char *argv[])
+{
+
+    /*
+     *      This method times the per node loops of training and of
+     *      DecisionTree::Travel, bucketing feature responses against the
+     *      candidate thresholds and partitioning the samples of a node, with
+     *      the kernels of nodekernels.h against the loops they replaced, on
+     *      random responses at node sizes of 1k, 16k and 256k samples.
+     *      It is a benchmark, not a test: it only reports the timings
+     *
+     *      Takes optional input arguments:
+     *         -t   Candidate Threshold Number (default 10)
+     *         -r   Samples Timed Per Node Size (default 2^26)
+     *
+                                                          */
+
+    cerr << " \n\n\t\tiCell Bench \n\t\tby Hyo Min Lee \n\n" << endl;
+
+    // Parse command line arguments
+    size_t thresholdNum = 10;
+    size_t sampleNum = 1 << 26;
+
+    bool thresholdNum_ = true;
+    bool sampleNum_ = true;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            if (thresholdNum_)
+            {
+                thresholdNum = atoi(argv[i+1]);
+                i++;
+                thresholdNum_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple threshold numbers!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            if (sampleNum_)
+            {
+                sampleNum = atol(argv[i+1]);
+                i++;
+                sampleNum_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple sample numbers!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // Verify command line arguments
+    if ((thresholdNum < 1) || (thresholdNum > 1000))
+    {
+        cerr << "ERROR: Threshold number should be between 1 and 1000!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (sampleNum < (1 << 18))
+    {
+        cerr << "ERROR: Sample number should be at least 262144!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    const SimdLevel level = DetectSimdLevel();
+    const char* levelNames[] = {"scalar", "AVX2", "AVX-512"};
+
+    // Display the input parameters for verification
+    cerr << "\nThreshold number: " << thresholdNum << endl;
+    cerr << "Samples timed per node size: " << sampleNum << endl;
+    cerr << "Bucketing kernel: " << levelNames[level] << "\n" << endl;
+
+    Random random(1);
+    const size_t nodeSizes[] = {1 << 10, 1 << 14, 1 << 18};
+    const size_t maxNodeSize = 1 << 18;
+
+    // Random responses and sorted thresholds, a random half of the samples
+    // going right, as the branches of the old loops see at a split node
+    std::vector<double> responses(maxNodeSize);
+    for (size_t i = 0; i < maxNodeSize; i++)
+    {
+        responses[i] = random.RandD();
+    }
+    std::vector<double> thresholds(thresholdNum);
+    for (size_t k = 0; k < thresholdNum; k++)
+    {
+        thresholds[k] = random.RandD();
+    }
+    std::sort(thresholds.begin(), thresholds.end());
+    std::vector<unsigned int> buckets(maxNodeSize);
+    std::vector<unsigned char> sides(maxNodeSize);
+    std::vector<bool> sideBits(maxNodeSize);
+    for (size_t i = 0; i < maxNodeSize; i++)
+    {
+        sides[i] = random.RandI(0, 2);
+        sideBits[i] = sides[i];
+    }
+    std::vector<index_t> indices(maxNodeSize);
+    for (size_t i = 0; i < maxNodeSize; i++)
+    {
+        indices[i] = i;
+    }
+    std::vector<index_t> index(maxNodeSize);
+    std::vector<index_t> scratch(maxNodeSize);
+    std::vector<bool> response(maxNodeSize);
+
+    cout << setw(10) << "samples" << setw(12) << "kernel"
+         << setw(16) << "old ns/sample" << setw(16) << "new ns/sample"
+         << setw(10) << "speedup" << endl;
+
+    MPTimer timer;
+    size_t check = 0;
+    for (size_t s = 0; s < sizeof(nodeSizes) / sizeof(nodeSizes[0]); s++)
+    {
+        const size_t n = nodeSizes[s];
+        const size_t repeats = sampleNum / n;
+
+        timer.Start();
+        for (size_t r = 0; r < repeats; r++)
+        {
+            BucketWhile(&responses[0], n, &thresholds[0], thresholdNum, &buckets[0]);
+            check += buckets[r % n];
+        }
+        const double oldBucket = timer.StopAndSpendSecond();
+        timer.Start();
+        for (size_t r = 0; r < repeats; r++)
+        {
+            BucketResponses(level, &responses[0], n, &thresholds[0], thresholdNum, &buckets[0]);
+            check += buckets[r % n];
+        }
+        const double newBucket = timer.StopAndSpendSecond();
+
+        // Every repeat partitions the node afresh, the copy is timed with
+        // both partitions
+        timer.Start();
+        for (size_t r = 0; r < repeats; r++)
+        {
+            std::copy(indices.begin(), indices.begin() + n, index.begin());
+            std::copy(sideBits.begin(), sideBits.begin() + n, response.begin());
+            check += PartitionSwap(response, index, 0, n);
+        }
+        const double oldPartition = timer.StopAndSpendSecond();
+        timer.Start();
+        for (size_t r = 0; r < repeats; r++)
+        {
+            std::copy(indices.begin(), indices.begin() + n, index.begin());
+            check += Partition(sides, index, 0, n, scratch);
+        }
+        const double newPartition = timer.StopAndSpendSecond();
+
+        const double nsPerSample = 1e9 / (repeats * n);
+        cout << fixed << setprecision(3)
+             << setw(10) << n << setw(12) << "bucket"
+             << setw(16) << oldBucket * nsPerSample << setw(16) << newBucket * nsPerSample
+             << setw(10) << oldBucket / newBucket << endl;
+        cout << setw(10) << n << setw(12) << "partition"
+             << setw(16) << oldPartition * nsPerSample << setw(16) << newPartition * nsPerSample
+             << setw(10) << oldPartition / newPartition << endl;
+    }
+
+    // Keeps the timed loops from being optimized away
+    cerr << "\nChecksum: " << check << endl;
+
+    return EXIT_SUCCESS;
+}
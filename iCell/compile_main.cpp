@@ -0,0 +1,145 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "Library/classification.h"
+#include "Library/forest.h"
+#include "Library/compiledforest.h"
+#include "Library/codegen.h"
+
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+
+    /*
+     *      This method reads a forest.dat file and writes C++ source
+     *      specialized to it, to be compiled into a kernel for icell_apply
+     *
+     *      Requires two input arguments:
+     *         -f   Input Forest Filename
+     *         -o   Output Source Filename
+     *         -s   Code Style (nested or branchfree, optional)
+     *
+                                                          */
+
+    cerr << " \n\n\t\tiCell Compile \n\t\tby Hyo Min Lee \n\n" << endl;
+
+    // Parse command line arguments
+    string forestFilename = "";
+    string outputFilename = "";
+    string style = "nested";
+
+    bool forestFilename_ = true;
+    bool outputFilename_ = true;
+    bool style_ = true;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0)
+        {
+            if (forestFilename_)
+            {
+                forestFilename = argv[i+1];
+                i++;
+                forestFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple forest files!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            if (outputFilename_)
+            {
+                outputFilename = argv[i+1];
+                i++;
+                outputFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot have multiple output files!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            if (style_)
+            {
+                style = argv[i+1];
+                i++;
+                style_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the code style multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // Verify command line arguments
+    if (forestFilename_)
+    {
+        cerr << "ERROR: No forest file specified!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (outputFilename_)
+    {
+        cerr << "ERROR: No output file specified!" << endl;
+        return EXIT_FAILURE;
+    }
+    if ((style != "nested") && (style != "branchfree"))
+    {
+        cerr << "ERROR: Code style should be nested or branchfree!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Display the input parameters for verification
+    cerr << "\nForest filename: " << forestFilename << endl;
+    cerr << "Output filename: " << outputFilename << endl;
+    cerr << "Code style: " << style << "\n" << endl;
+
+    // Read the forest as icell_apply does
+    typedef float GreyType;
+    typedef float LabelType;
+    typedef Histogram<GreyType, LabelType> RFHistogramType;
+    typedef AxisAlignedClassifier<GreyType, LabelType> RFAxisClassifierType;
+    typedef DecisionForest<RFHistogramType, RFAxisClassifierType, GreyType> RandomForestType;
+
+    RandomForestType forest(true);
+    std::filebuf fb;
+    fb.open(forestFilename.c_str(), ios::binary | ios::in);
+    if (!fb.is_open())
+    {
+        cerr << "ERROR: Cannot open the forest file " << forestFilename << "!" << endl;
+        return EXIT_FAILURE;
+    }
+    std::istream fin(&fb);
+    forest.Read(fin);
+    fb.close();
+
+    CompiledForest<GreyType> compiledForest(forest);
+
+    // Write the specialized source
+    std::ofstream fout(outputFilename.c_str());
+    if (!fout.is_open())
+    {
+        cerr << "ERROR: Cannot write the output file " << outputFilename << "!" << endl;
+        return EXIT_FAILURE;
+    }
+    WriteForestSource(compiledForest, (style == "branchfree") ? BranchFree : NestedBranches, fout);
+    fout.close();
+
+    cerr << "Saved the source of " << compiledForest.TreeNum() << " trees as: " << outputFilename << endl;
+    cerr << "Build the kernel with, for example:\n\tc++ -O3 -march=native -shared -fPIC "
+         << outputFilename << " -o forest_kernel.so" << endl;
+    cerr << "and classify with icell_apply -e kernel -k forest_kernel.so" << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -11,16 +11,21 @@
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkBilateralImageFilter.h"
 #include "itkStreamingImageFilter.h"
+#include "itkShrinkImageFilter.h"
 #include "QuickView.h"
 
 #include "Library/classification.h"
 #include "Library/data.h"
 #include "Library/RFsample.h"
+#include "Library/RFtiff.h"
 #include "Library/forest.h"
 
 #include "ImageCollectionToImageFilter.h"
 #include "itkImageRegionIterator.h"
 
+#include <fstream>
+#include <sstream>
+
 
 using namespace std;
 
@@ -57,6 +62,45 @@ public:
     }
 };
 
+// Tree indices from a list such as "0-4,9": single indices and inclusive
+// ranges separated by commas
+bool ParseTreeList(const string list, vector<size_t> &treeIdx)
+{
+    stringstream items(list);
+    string item;
+    while (getline(items, item, ','))
+    {
+        size_t first = 0;
+        size_t last = 0;
+        char dash = 0;
+        stringstream range(item);
+        if (!(range >> first))
+        {
+            return false;
+        }
+        if (range >> dash)
+        {
+            if ((dash != '-') || !(range >> last) || (last < first))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            last = first;
+        }
+        if (!(range >> ws).eof())
+        {
+            return false;
+        }
+        for (size_t k = first; k <= last; k++)
+        {
+            treeIdx.push_back(k);
+        }
+    }
+    return !treeIdx.empty();
+}
+
 int main(int argc, char *argv[])
 {
     /* This method trains an RF classifier and saves
@@ -68,6 +112,13 @@ int main(int argc, char *argv[])
      *     -f    Forest Filename
      *     -nc   Number of Classes
      *     -sd   Number of Streaming Divisions
+     *     -uf   Forest to Update, keeping the trees not retrained (optional)
+     *     -rt   Trees to Retrain in the updated forest, as "0-4,9" (optional)
+     *     -at   Number of Trees to Add to the updated forest (optional)
+     *     -sf   Shrink Factor, trains a coarse forest for icell_apply -cf (optional)
+     *     -hb   Histogram Bins per feature, scores every bin boundary instead of
+     *           random thresholds, 32 to 64 is a good start (optional)
+     *     -seed Random Seed, the same seed trains the same forest (optional)
     */
 
     // Display Title
@@ -79,12 +130,24 @@ int main(int argc, char *argv[])
     string forestFilename = "";
     unsigned short nClass = 0;
     unsigned int nStream = 0;
+    string updateFilename = "";
+    string retrainList = "";
+    unsigned int nAddTree = 0;
+    unsigned int shrinkFactor = 1;
+    unsigned int nBin = 0;
+    unsigned int seed = 0;
 
     bool inputFilename_ = true;
     bool segFilename_ = true;
     bool forestFilename_ = true;
     bool nClass_ = true;
     bool nStream_ = true;
+    bool updateFilename_ = true;
+    bool retrainList_ = true;
+    bool nAddTree_ = true;
+    bool shrinkFactor_ = true;
+    bool nBin_ = true;
+    bool seed_ = true;
 
     for (unsigned int i = 0; i < argc; i++)
     {
@@ -158,6 +221,90 @@ int main(int argc, char *argv[])
                 return EXIT_FAILURE;
             }
         }
+        else if (strcmp(argv[i], "-uf") == 0)
+        {
+            if (updateFilename_)
+            {
+                updateFilename = argv[i+1];
+                i++;
+                updateFilename_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot update multiple forests!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-rt") == 0)
+        {
+            if (retrainList_)
+            {
+                retrainList = argv[i+1];
+                i++;
+                retrainList_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the trees to retrain multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-at") == 0)
+        {
+            if (nAddTree_)
+            {
+                nAddTree = stoi(argv[i+1]);
+                i++;
+                nAddTree_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set # of trees to add multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-sf") == 0)
+        {
+            if (shrinkFactor_)
+            {
+                shrinkFactor = stoi(argv[i+1]);
+                i++;
+                shrinkFactor_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the shrink factor multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-hb") == 0)
+        {
+            if (nBin_)
+            {
+                nBin = stoi(argv[i+1]);
+                i++;
+                nBin_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set # of histogram bins multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-seed") == 0)
+        {
+            if (seed_)
+            {
+                seed = stoul(argv[i+1]);
+                i++;
+                seed_ = false;
+            }
+            else
+            {
+                cerr << "ERROR: Cannot set the random seed multiple times!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
     }
 
     // Verify command line arguments
@@ -192,12 +339,58 @@ int main(int argc, char *argv[])
         cerr << "Number of streaming division is not specified. \nProceeding with default value of 1." << endl;
         nStream = 1;
     }
+    vector<size_t> retrainIdx;
+    if (updateFilename_ && (!retrainList_ || !nAddTree_))
+    {
+        cerr << "ERROR: Trees are only retrained or added in a forest to update!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!updateFilename_ && retrainList_ && (nAddTree == 0))
+    {
+        cerr << "ERROR: A forest to update needs trees to retrain or add!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!retrainList_ && !ParseTreeList(retrainList, retrainIdx))
+    {
+        cerr << "ERROR: Trees to retrain should be a list such as 0-4,9!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (shrinkFactor == 0)
+    {
+        cerr << "ERROR: Shrink factor should be positive!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!nBin_ && ((nBin < 2) || (nBin > 65536)))
+    {
+        cerr << "ERROR: # of histogram bins should be from 2 to 65536!" << endl;
+        return EXIT_FAILURE;
+    }
+    if (seed_)
+    {
+        // Printed below, so that the forest can be trained again
+        seed = time(NULL);
+    }
 
     // Display the input parameters for verification
     cerr << "\nInput image: " << inputFilename << endl;
     cerr << "Input segmentation: " << segFilename << endl;
     cerr << "Forest filename: " << forestFilename << endl;
     cerr << "# of classes: " << nClass << endl;
+    if (!updateFilename_)
+    {
+        cerr << "Forest to update: " << updateFilename << endl;
+        cerr << "Trees to retrain: " << (retrainList_ ? "none" : retrainList) << endl;
+        cerr << "# of trees to add: " << nAddTree << endl;
+    }
+    if (!shrinkFactor_)
+    {
+        cerr << "Shrink factor: " << shrinkFactor << endl;
+    }
+    if (!nBin_)
+    {
+        cerr << "# of histogram bins: " << nBin << endl;
+    }
+    cerr << "Random seed: " << seed << endl;
     cerr << "# of stream divisions: " << nStream  << "\n" << endl;
 
     // ================   PREPROCESSING INPUT IMAGES   ================
@@ -209,6 +402,11 @@ int main(int argc, char *argv[])
     typedef itk::ImageFileReader<RGBImageType> readerType; // file reader type
     readerType::Pointer reader = readerType::New(); // reader object
     reader->SetFileName(inputFilename.c_str());
+    if (itk::RFtiffImageIO::IsTiledTIFF(inputFilename))
+    {
+        // Whole slides and other tiled TIFFs are read through their tiles
+        reader->SetImageIO(itk::RFtiffImageIO::New());
+    }
 
     // Separate the RGB image
     typedef itk::ImageAdaptor<RGBImageType, RedChannelPixelAccessor> RedAdaptorType;
@@ -219,9 +417,24 @@ int main(int argc, char *argv[])
     GreenAdaptorType::Pointer greenAdaptor = GreenAdaptorType::New();
     BlueAdaptorType::Pointer blueAdaptor = BlueAdaptorType::New();
 
-    redAdaptor->SetImage(reader->GetOutput());
-    greenAdaptor->SetImage(reader->GetOutput());
-    blueAdaptor->SetImage(reader->GetOutput());
+    // A coarse forest is trained on the image and segmentation shrunk as
+    // icell_apply shrinks the image it classifies first
+    typedef itk::ShrinkImageFilter<RGBImageType, RGBImageType> ShrinkType;
+    ShrinkType::Pointer shrink = ShrinkType::New();
+    shrink->SetInput(reader->GetOutput());
+    shrink->SetShrinkFactors(shrinkFactor);
+    if (shrinkFactor_)
+    {
+        redAdaptor->SetImage(reader->GetOutput());
+        greenAdaptor->SetImage(reader->GetOutput());
+        blueAdaptor->SetImage(reader->GetOutput());
+    }
+    else
+    {
+        redAdaptor->SetImage(shrink->GetOutput());
+        greenAdaptor->SetImage(shrink->GetOutput());
+        blueAdaptor->SetImage(shrink->GetOutput());
+    }
 
     typedef itk::Image<float,2> ImageType;
 
@@ -333,7 +546,18 @@ int main(int argc, char *argv[])
     {
         sample->SetInputImage(Input[i]);
     }
-    sample->SetInputSeg(reader_->GetOutput());
+    typedef itk::ShrinkImageFilter<ImageType, ImageType> SegShrinkType;
+    SegShrinkType::Pointer segShrink = SegShrinkType::New();
+    segShrink->SetInput(reader_->GetOutput());
+    segShrink->SetShrinkFactors(shrinkFactor);
+    if (shrinkFactor_)
+    {
+        sample->SetInputSeg(reader_->GetOutput());
+    }
+    else
+    {
+        sample->SetInputSeg(segShrink->GetOutput());
+    }
 
     // Run the dummy output to a streaming filter
     typedef itk::StreamingImageFilter<ImageType, ImageType> StreamingFilterType;
@@ -404,6 +628,8 @@ int main(int argc, char *argv[])
     params.splitIG = 0.1;
     params.leafEntropy = 0.05;
     params.verbose = true;
+    params.histogramBins = nBin;
+    params.seed = seed;
 
      cerr << "Training Has Started..." << endl;
 
@@ -411,7 +637,38 @@ int main(int argc, char *argv[])
     RandomForestType forest = RandomForestType(true);
     std::map<std::size_t, LabelType> indexToLabelMap;
     bool are_labels_valid;
-    classification.Learning(params, Sample, forest, are_labels_valid, indexToLabelMap);
+    if (updateFilename_)
+    {
+        classification.Learning(params, Sample, forest, are_labels_valid, indexToLabelMap);
+    }
+    else
+    {
+        // Only the listed trees are trained again and the new ones added,
+        // so icell_apply can update its vote sums by travelling only those
+        filebuf updateFb;
+        if (!updateFb.open(updateFilename.c_str(), ios::binary | ios::in))
+        {
+            cerr << "ERROR: Cannot open the forest to update " << updateFilename << "!" << endl;
+            return EXIT_FAILURE;
+        }
+        istream fin(&updateFb);
+        forest.Read(fin);
+        updateFb.close();
+        for (size_t k = 0; k < retrainIdx.size(); k++)
+        {
+            if (retrainIdx[k] >= forest.trees_.size())
+            {
+                cerr << "ERROR: The forest to update has no tree " << retrainIdx[k] << "!" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        for (unsigned int k = 0; k < nAddTree; k++)
+        {
+            retrainIdx.push_back(forest.trees_.size() + k);
+        }
+        classification.Updating(params, Sample, forest, retrainIdx, are_labels_valid, indexToLabelMap);
+        cerr << "Trained " << retrainIdx.size() << " of the " << forest.trees_.size() << " trees" << endl;
+    }
 
     cerr << "Training Has Completed..." << endl;
 
@@ -0,0 +1,81 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "Library/classification.h"
+
+
+using namespace std;
+
+typedef float DataType;
+typedef float LabelType;
+typedef AxisAlignedClassifier<DataType, LabelType> ClassifierType;
+typedef Classification<DataType, LabelType, ClassifierType> ClassificationType;
+typedef ClassificationType::TrainingDataT TrainingDataType;
+typedef ClassificationType::DecisionForestT ForestType;
+typedef ClassificationType::TrainerT TrainerType;
+
+const size_t sampleNum = 20000;
+const size_t featureNum = 8;
+const size_t classNum = 3;
+
+// Three classes, each brighter in its own features, with noise enough for
+// trees of some depth
+void MakeData(TrainingDataType &data)
+{
+    srand(1);
+    for (size_t i = 0; i < sampleNum; i++)
+    {
+        int label = rand() % classNum;
+        data.label[i] = label;
+        for (size_t f = 0; f < featureNum; f++)
+        {
+            data.data[i][f] = (rand() % 256) * 0.5f + ((f % classNum == (size_t)label) ? 40.f : 0.f);
+        }
+    }
+}
+
+// The forest file of a forest trained with nodes of taskSampleNum samples
+// or more split into tasks
+string TrainForest(const TrainingDataType &data, const TrainingParameters &parameters,
+                   size_t taskSampleNum)
+{
+    ClassificationType::ClassificationContextT context(featureNum, classNum);
+    TrainerType trainer(data, parameters, context);
+    trainer.taskSampleNum_ = taskSampleNum;
+    ForestType forest(true);
+    trainer.Training(forest);
+
+    stringstream forestFile;
+    forest.Write(forestFile);
+    return forestFile.str();
+}
+
+// Trees trained with and without tasks, by any number of threads, must be
+// the same, and so must their leaves
+int main()
+{
+    TrainingDataType data(sampleNum, featureNum);
+    MakeData(data);
+
+    TrainingParameters parameters;
+    parameters.treeNum = 4;
+    parameters.treeDepth = 0;
+    parameters.candidateNodeClassifierNum = 10;
+    parameters.candidateClassifierThresholdNum = 10;
+    parameters.subSamplePercent = 0;
+    parameters.splitIG = 0.01;
+    parameters.leafEntropy = 0.05;
+    parameters.verbose = false;
+    parameters.histogramBins = 0;
+    parameters.seed = 3;
+
+    string serial = TrainForest(data, parameters, sampleNum + 1);
+    string tasks = TrainForest(data, parameters, 64);
+    if (serial != tasks)
+    {
+        cerr << "ERROR: The trees trained with tasks differ from the serial ones!" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkRGBPixel.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+#include "Library/classification.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+
+using namespace std;
+
+typedef itk::Image<itk::RGBPixel<float>, 2> RGBImageType;
+typedef itk::Image<float, 2> LabelImageType;
+typedef itk::VectorImage<float, 2> MapImageType;
+typedef itk::VectorImage<unsigned short, 2> LeafImageType;
+
+const unsigned int width = 200;
+const unsigned int height = 150;
+const unsigned int glassWidth = 64;
+const unsigned int nTree = 8;
+const int backgroundLabel = 7;
+
+// Brightfield-like test image: bright glass over the first glassWidth
+// columns, which a foreground threshold masks out a whole tile column of,
+// and smooth darker patterns elsewhere
+void WriteImage(const string fileName)
+{
+    RGBImageType::Pointer image = RGBImageType::New();
+    RGBImageType::SizeType size;
+    size[0] = width;
+    size[1] = height;
+    image->SetRegions(size);
+    image->Allocate();
+    typedef itk::ImageRegionIterator<RGBImageType> IteratorType;
+    IteratorType it(image, image->GetLargestPossibleRegion());
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+        double x = it.GetIndex()[0];
+        double y = it.GetIndex()[1];
+        itk::RGBPixel<float> pixel;
+        if (x < glassWidth)
+        {
+            pixel.Fill(255);
+        }
+        else
+        {
+            pixel[0] = 100 + 80 * sin(x / 9) * cos(y / 7);
+            pixel[1] = 100 + 80 * cos((x + y) / 11);
+            pixel[2] = 100 + 80 * sin(x / 5 + y / 13);
+        }
+        it.Set(pixel);
+    }
+    typedef itk::ImageFileWriter<RGBImageType> WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(fileName);
+    writer->SetInput(image);
+    writer->Update();
+}
+
+// A forest of 3 classes over the 15 features of icell_apply, trained on
+// random samples spanning their ranges, so the pixels reach many leaves
+void WriteForest(const string fileName)
+{
+    typedef Classification<float, float, AxisAlignedClassifier<float, float> > ClassificationType;
+    typedef DecisionForest<Histogram<float, float>, AxisAlignedClassifier<float, float>, float> ForestType;
+    const unsigned int nSample = 4000;
+    const unsigned int nComp = 15;
+    ClassificationType::TrainingDataT samples(nSample, nComp);
+    Random random(1);
+    for (unsigned int i = 0; i < nSample; i++)
+    {
+        for (unsigned int c = 0; c < nComp; c++)
+        {
+            samples.data[i][c] = random.RandD() * 300 - 50;
+        }
+        samples.label[i] = (samples.data[i][0] + samples.data[i][4] > 200) + (samples.data[i][1] > 120);
+    }
+
+    TrainingParameters params;
+    params.treeDepth = 8;
+    params.treeNum = nTree;
+    params.candidateNodeClassifierNum = 10;
+    params.candidateClassifierThresholdNum = 10;
+    params.subSamplePercent = 0;
+    params.splitIG = 0.01;
+    params.leafEntropy = 0.05;
+    params.verbose = false;
+    params.histogramBins = 0;
+    params.seed = 1;
+
+    ForestType forest(true);
+    std::map<std::size_t, float> indexToLabelMap;
+    bool are_labels_valid;
+    ClassificationType classification;
+    classification.Learning(params, samples, forest, are_labels_valid, indexToLabelMap);
+
+    filebuf fb;
+    fb.open(fileName.c_str(), ios::binary | ios::out);
+    ostream fout(&fb);
+    forest.Write(fout);
+    fb.close();
+}
+
+template<class TImage>
+typename TImage::Pointer ReadImage(const string fileName)
+{
+    typedef itk::ImageFileReader<TImage> ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(fileName);
+    reader->Update();
+    return reader->GetOutput();
+}
+
+// A map written piece by piece spans the whole image
+bool CheckSize(const itk::ImageBase<2> *map, const string name)
+{
+    if ((map->GetLargestPossibleRegion().GetSize(0) != width)
+        || (map->GetLargestPossibleRegion().GetSize(1) != height))
+    {
+        cerr << "ERROR: The " << name << " is " << map->GetLargestPossibleRegion().GetSize()
+             << " instead of the image's " << width << " x " << height << "!" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Every component of the two map pixels within tolerance
+template<class TPixel>
+bool SamePixel(const TPixel &a, const TPixel &b, double tolerance)
+{
+    if (a.GetSize() != b.GetSize())
+    {
+        return false;
+    }
+    for (unsigned int c = 0; c < a.GetSize(); c++)
+    {
+        if (fabs(double(a[c]) - double(b[c])) > tolerance)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class TPixel>
+bool ZeroPixel(const TPixel &a)
+{
+    for (unsigned int c = 0; c < a.GetSize(); c++)
+    {
+        if (a[c] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+
+    /*
+     *      This method tests the maps icell_apply writes in tiled mode,
+     *      pasted tile by tile into their files as the labels are. It
+     *      classifies a test image by tiles with probability, leaf index
+     *      and vote sum maps, then predicts again from the leaf index map
+     *      and checks that every map spans the whole image and agrees with
+     *      the labels at every pixel. A masked run, with a column of tiles
+     *      of background, must give the same probability and vote sum maps
+     *      in the mask and zeros out of it, and refuse a leaf index map.
+     *
+     *      Requires two input arguments:
+     *         icell_apply executable
+     *         directory of the test files
+     *
+                                                          */
+
+    if (argc < 3)
+    {
+        cerr << "Usage: " << endl;
+        cerr << argv[0] << " icell_apply testDirectory" << endl;
+        return EXIT_FAILURE;
+    }
+    const string apply = argv[1];
+    const string directory = string(argv[2]) + "/";
+
+    WriteImage(directory + "tiled_image.mha");
+    WriteForest(directory + "tiled_forest.dat");
+
+    ostringstream common;
+    common << apply << " -f " << directory << "tiled_forest.dat -nc 3";
+    ostringstream tiled;
+    tiled << common.str() << " -i " << directory << "tiled_image.mha -tile 64"
+          << " -o " << directory << "tiled_labels.mha"
+          << " -p " << directory << "tiled_probabilities.mha"
+          << " -l " << directory << "tiled_leaves.mha"
+          << " -vs " << directory << "tiled_votes.mha";
+    ostringstream repredict;
+    repredict << common.str() << " -rl " << directory << "tiled_leaves.mha"
+              << " -o " << directory << "repredicted_labels.mha"
+              << " -p " << directory << "repredicted_probabilities.mha";
+    ostringstream masked;
+    masked << common.str() << " -i " << directory << "tiled_image.mha -tile 64"
+           << " -mt 220 -bl " << backgroundLabel
+           << " -o " << directory << "masked_labels.mha"
+           << " -p " << directory << "masked_probabilities.mha"
+           << " -vs " << directory << "masked_votes.mha";
+    const string commands[3] = {tiled.str(), repredict.str(), masked.str()};
+    for (unsigned int k = 0; k < 3; k++)
+    {
+        cerr << commands[k] << endl;
+        if (system(commands[k].c_str()) != 0)
+        {
+            cerr << "ERROR: icell_apply failed!" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    // The pixels out of the mask reach no leaf
+    ostringstream maskedLeaves;
+    maskedLeaves << masked.str() << " -l " << directory << "masked_leaves.mha";
+    cerr << maskedLeaves.str() << endl;
+    if (system(maskedLeaves.str().c_str()) == 0)
+    {
+        cerr << "ERROR: icell_apply kept a leaf index map with a mask!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    LabelImageType::Pointer labels = ReadImage<LabelImageType>(directory + "tiled_labels.mha");
+    MapImageType::Pointer probabilities = ReadImage<MapImageType>(directory + "tiled_probabilities.mha");
+    LeafImageType::Pointer leaves = ReadImage<LeafImageType>(directory + "tiled_leaves.mha");
+    MapImageType::Pointer votes = ReadImage<MapImageType>(directory + "tiled_votes.mha");
+    LabelImageType::Pointer repredictedLabels = ReadImage<LabelImageType>(directory + "repredicted_labels.mha");
+    MapImageType::Pointer repredictedProbabilities =
+        ReadImage<MapImageType>(directory + "repredicted_probabilities.mha");
+    LabelImageType::Pointer maskedLabels = ReadImage<LabelImageType>(directory + "masked_labels.mha");
+    MapImageType::Pointer maskedProbabilities = ReadImage<MapImageType>(directory + "masked_probabilities.mha");
+    MapImageType::Pointer maskedVotes = ReadImage<MapImageType>(directory + "masked_votes.mha");
+
+    bool passed = CheckSize(labels, "label image") && CheckSize(probabilities, "probability map")
+                  && CheckSize(leaves, "leaf index map") && CheckSize(votes, "vote sum map")
+                  && CheckSize(maskedProbabilities, "masked probability map")
+                  && CheckSize(maskedVotes, "masked vote sum map");
+    if (!passed)
+    {
+        return EXIT_FAILURE;
+    }
+    if ((probabilities->GetNumberOfComponentsPerPixel() != 3) || (votes->GetNumberOfComponentsPerPixel() != 3)
+        || (leaves->GetNumberOfComponentsPerPixel() != nTree))
+    {
+        cerr << "ERROR: The maps have " << probabilities->GetNumberOfComponentsPerPixel() << ", "
+             << leaves->GetNumberOfComponentsPerPixel() << " and " << votes->GetNumberOfComponentsPerPixel()
+             << " components instead of 3, " << nTree << " and 3!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    typedef itk::ImageRegionConstIterator<LabelImageType> LabelIteratorType;
+    typedef itk::ImageRegionConstIterator<MapImageType> MapIteratorType;
+    typedef itk::ImageRegionConstIterator<LeafImageType> LeafIteratorType;
+    const LabelImageType::RegionType region = labels->GetLargestPossibleRegion();
+    LabelIteratorType labelIT(labels, region);
+    MapIteratorType probabilityIT(probabilities, region);
+    LeafIteratorType leafIT(leaves, region);
+    MapIteratorType voteIT(votes, region);
+    LabelIteratorType repredictedLabelIT(repredictedLabels, region);
+    MapIteratorType repredictedProbabilityIT(repredictedProbabilities, region);
+    LabelIteratorType maskedLabelIT(maskedLabels, region);
+    MapIteratorType maskedProbabilityIT(maskedProbabilities, region);
+    MapIteratorType maskedVoteIT(maskedVotes, region);
+    unsigned long mismatch = 0;
+    unsigned long maskedMismatch = 0;
+    unsigned long foreground = 0;
+    for (; !labelIT.IsAtEnd(); ++labelIT, ++probabilityIT, ++leafIT, ++voteIT, ++repredictedLabelIT,
+                               ++repredictedProbabilityIT, ++maskedLabelIT, ++maskedProbabilityIT, ++maskedVoteIT)
+    {
+        // The leaves give the labels and probabilities of the same pixel,
+        // the votes summed over the trees its probabilities
+        MapImageType::PixelType averageVotes = voteIT.Get();
+        for (unsigned int c = 0; c < averageVotes.GetSize(); c++)
+        {
+            averageVotes[c] /= nTree;
+        }
+        if ((repredictedLabelIT.Get() != labelIT.Get())
+            || !SamePixel(repredictedProbabilityIT.Get(), probabilityIT.Get(), 1e-5)
+            || !SamePixel(averageVotes, probabilityIT.Get(), 1e-5))
+        {
+            mismatch++;
+        }
+
+        if (maskedLabelIT.Get() == backgroundLabel)
+        {
+            if (!ZeroPixel(maskedProbabilityIT.Get()) || !ZeroPixel(maskedVoteIT.Get()))
+            {
+                maskedMismatch++;
+            }
+        }
+        else
+        {
+            foreground++;
+            if ((maskedLabelIT.Get() != labelIT.Get())
+                || !SamePixel(maskedProbabilityIT.Get(), probabilityIT.Get(), 1e-6)
+                || !SamePixel(maskedVoteIT.Get(), voteIT.Get(), 1e-5))
+            {
+                maskedMismatch++;
+            }
+        }
+    }
+
+    cerr << "Pixels whose maps disagree with their labels: " << mismatch << " of " << region.GetNumberOfPixels() << endl;
+    cerr << "Pixels whose masked maps disagree: " << maskedMismatch << " (" << foreground
+         << " in the mask)" << endl;
+    if ((foreground == 0) || (foreground == region.GetNumberOfPixels()))
+    {
+        cerr << "ERROR: The mask should cover some but not all of the image!" << endl;
+        return EXIT_FAILURE;
+    }
+    return ((mismatch == 0) && (maskedMismatch == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}